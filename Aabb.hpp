@@ -0,0 +1,127 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "RTweekend.hpp"
+
+class Aabb
+{
+public:
+    Interval x, y, z;
+
+    Aabb()
+    {} // The default AABB is empty, since intervals are empty by default.
+
+    Aabb(const Interval &x, const Interval &y, const Interval &z) : x(x), y(y), z(z)
+    {}
+
+    Aabb(const Point3 &a, const Point3 &b)
+    {
+        // Treat the two points a and b as extrema for the bounding box, so we don't require a
+        // particular minimum/maximum coordinate order.
+        x = (a[0] <= b[0]) ? Interval(a[0], b[0]) : Interval(b[0], a[0]);
+        y = (a[1] <= b[1]) ? Interval(a[1], b[1]) : Interval(b[1], a[1]);
+        z = (a[2] <= b[2]) ? Interval(a[2], b[2]) : Interval(b[2], a[2]);
+    }
+
+    Aabb(const Aabb &box0, const Aabb &box1)
+    {
+        x = Interval(box0.x, box1.x);
+        y = Interval(box0.y, box1.y);
+        z = Interval(box0.z, box1.z);
+    }
+
+    const Interval &AxisInterval(int n) const
+    {
+        if (n == 1) return y;
+        if (n == 2) return z;
+        return x;
+    }
+
+    bool Hit(const Ray &r, Interval rayT) const
+    {
+        const Point3 &rayOrig = r.origin();
+        const Vec3 &rayDir = r.direction();
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const Interval &ax = AxisInterval(axis);
+            const Real adinv = 1 / rayDir[axis];
+
+            auto t0 = (ax.min - rayOrig[axis]) * adinv;
+            auto t1 = (ax.max - rayOrig[axis]) * adinv;
+
+            if (t0 > t1)
+            {
+                std::swap(t0, t1);
+            }
+
+            if (t0 > rayT.min) rayT.min = t0;
+            if (t1 < rayT.max) rayT.max = t1;
+
+            if (rayT.max <= rayT.min)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Slab test with a precomputed reciprocal ray direction, for traversals that test many boxes
+    // against the same Ray.
+    bool Hit(const Point3 &rayOrig, const Vec3 &invDir, Interval rayT) const
+    {
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const Interval &ax = AxisInterval(axis);
+
+            auto t0 = (ax.min - rayOrig[axis]) * invDir[axis];
+            auto t1 = (ax.max - rayOrig[axis]) * invDir[axis];
+
+            if (t0 > t1)
+            {
+                std::swap(t0, t1);
+            }
+
+            if (t0 > rayT.min) rayT.min = t0;
+            if (t1 < rayT.max) rayT.max = t1;
+
+            if (rayT.max <= rayT.min)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int LongestAxis() const
+    {
+        // Returns the index of the longest axis of the bounding box.
+        if (x.Size() > y.Size())
+        {
+            return x.Size() > z.Size() ? 0 : 2;
+        }
+        return y.Size() > z.Size() ? 1 : 2;
+    }
+
+    double SurfaceArea() const
+    {
+        // Empty boxes have negative sizes; they contribute nothing to the SAH cost.
+        if (x.Size() < 0 || y.Size() < 0 || z.Size() < 0)
+        {
+            return 0;
+        }
+        return 2.0 * (x.Size() * y.Size() + y.Size() * z.Size() + z.Size() * x.Size());
+    }
+
+    Point3 Centroid() const
+    {
+        return Point3(0.5 * (x.min + x.max), 0.5 * (y.min + y.max), 0.5 * (z.min + z.max));
+    }
+
+    static const Aabb empty, universe;
+};
+
+inline const Aabb Aabb::empty = Aabb(Interval::empty, Interval::empty, Interval::empty);
+inline const Aabb Aabb::universe = Aabb(Interval::universe, Interval::universe, Interval::universe);
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Monotonic memory arena. Allocations bump a pointer through large cache line aligned blocks, so
+// arrays allocated one after another sit next to each other and cost no bookkeeping of their own.
+// Nothing is freed on its own: Reset() drops every allocation at once and keeps the largest block
+// for the next round, and the destructor frees the handful of blocks. Used for the scratch memory of
+// hierarchy builds, where one arena serves the spheres, every mesh and the instances in turn.
+class Arena
+{
+public:
+    static constexpr size_t Alignment = 64;
+
+    explicit Arena(size_t blockBytes = size_t(1) << 20) : blockBytes(blockBytes)
+    {}
+
+    Arena(const Arena &) = delete;
+
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena()
+    {
+        for (const auto &block: blocks)
+        {
+            ::operator delete(block.data, std::align_val_t(Alignment));
+        }
+    }
+
+    // Uninitialized storage for count values of T, aligned to a cache line. Only for types that need
+    // no destructor, since the arena never runs one.
+    template<typename T>
+    T *Allocate(size_t count)
+    {
+        static_assert(std::is_trivially_destructible_v<T>, "The arena never runs destructors");
+        static_assert(alignof(T) <= Alignment);
+
+        size_t bytes = (count * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+        if (blocks.empty() || used + bytes > blocks.back().size)
+        {
+            AddBlock(std::max(bytes, blockBytes));
+        }
+
+        auto *p = blocks.back().data + used;
+        used += bytes;
+        return reinterpret_cast<T *>(p);
+    }
+
+    // Frees every allocation. The largest block is kept, so an arena reset between similar jobs stops
+    // allocating once it has grown to the biggest of them.
+    void Reset()
+    {
+        if (blocks.empty())
+        {
+            return;
+        }
+
+        auto largest = std::max_element(blocks.begin(), blocks.end(), [](const Block &a, const Block &b)
+        { return a.size < b.size; });
+        std::swap(*largest, blocks.front());
+        for (size_t b = 1; b < blocks.size(); b++)
+        {
+            ::operator delete(blocks[b].data, std::align_val_t(Alignment));
+        }
+        blocks.resize(1);
+        used = 0;
+    }
+
+    // Bytes held in blocks, used or not.
+    size_t CapacityBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto &block: blocks)
+        {
+            bytes += block.size;
+        }
+        return bytes;
+    }
+
+private:
+    struct Block
+    {
+        std::byte *data;
+        size_t size;
+    };
+
+    size_t blockBytes;          // Smallest block to allocate
+    std::vector<Block> blocks;  // The last one is being filled
+    size_t used = 0;            // Bytes taken from the last block
+
+    void AddBlock(size_t size)
+    {
+        auto *data = static_cast<std::byte *>(::operator new(size, std::align_val_t(Alignment)));
+        blocks.push_back({data, size});
+        used = 0;
+    }
+};
+
+#endif
@@ -0,0 +1,191 @@
+#ifndef BVH_NODE_H
+#define BVH_NODE_H
+
+#include "RTweekend.hpp"
+#include "Aabb.hpp"
+#include "HitTable.hpp"
+#include "HitTableList.hpp"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+constexpr int SahBinCount = 12; // Number of centroid bins evaluated per axis
+
+// Splits the range [first, last) into two halves using the surface area heuristic, evaluated over
+// SahBinCount centroid bins on each axis. boxOf maps an element to its bounding box. Returns the
+// partition point, which is always strictly between first and last for ranges of two or more, and
+// stores the axis the range was split along in splitAxis if given. splitAxis is left alone when all
+// centroids coincide and the range is just halved.
+template<typename Iterator, typename BoxFunction>
+Iterator SahPartition(Iterator first, Iterator last, BoxFunction boxOf, int *splitAxis = nullptr)
+{
+    auto count = last - first;
+
+    Aabb centroidBounds;
+    for (auto it = first; it != last; ++it)
+    {
+        auto c = boxOf(*it).Centroid();
+        centroidBounds = Aabb(centroidBounds, Aabb(c, c));
+    }
+
+    struct Bin
+    {
+        Aabb bounds;
+        int count = 0;
+    };
+
+    double bestCost = RT_INFINITY;
+    int bestAxis = -1;
+    int bestSplit = 0;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        const Interval &extent = centroidBounds.AxisInterval(axis);
+        if (extent.Size() <= 0)
+        {
+            continue;
+        }
+
+        std::array<Bin, SahBinCount> bins;
+        auto scale = SahBinCount / extent.Size();
+        for (auto it = first; it != last; ++it)
+        {
+            auto box = boxOf(*it);
+            int b = std::min(SahBinCount - 1, int((box.Centroid()[axis] - extent.min) * scale));
+            bins[b].count++;
+            bins[b].bounds = Aabb(bins[b].bounds, box);
+        }
+
+        // Sweep from the right to collect the cost of every right-hand side, then from the left.
+        std::array<double, SahBinCount - 1> rightCost;
+        Aabb rightBox;
+        int rightCount = 0;
+        for (int i = SahBinCount - 1; i > 0; i--)
+        {
+            rightBox = Aabb(rightBox, bins[i].bounds);
+            rightCount += bins[i].count;
+            rightCost[i - 1] = rightCount * rightBox.SurfaceArea();
+        }
+
+        Aabb leftBox;
+        int leftCount = 0;
+        for (int i = 0; i < SahBinCount - 1; i++)
+        {
+            leftBox = Aabb(leftBox, bins[i].bounds);
+            leftCount += bins[i].count;
+            if (leftCount == 0 || leftCount == count)
+            {
+                continue;
+            }
+
+            auto cost = leftCount * leftBox.SurfaceArea() + rightCost[i];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    auto middle = first + count / 2;
+
+    // All centroids coincide, so no plane separates them; fall back to an even split.
+    if (bestAxis < 0)
+    {
+        return middle;
+    }
+
+    if (splitAxis)
+    {
+        *splitAxis = bestAxis;
+    }
+    const Interval &extent = centroidBounds.AxisInterval(bestAxis);
+    auto scale = SahBinCount / extent.Size();
+    auto split = std::partition(first, last, [&](const auto &element)
+    {
+        auto c = boxOf(element).Centroid()[bestAxis];
+        return std::min(SahBinCount - 1, int((c - extent.min) * scale)) <= bestSplit;
+    });
+
+    if (split == first || split == last)
+    {
+        std::nth_element(first, middle, last, [&](const auto &a, const auto &b)
+        {
+            return boxOf(a).Centroid()[bestAxis] < boxOf(b).Centroid()[bestAxis];
+        });
+        return middle;
+    }
+
+    return split;
+}
+
+class BvhNode : public HitTable
+{
+public:
+    BvhNode(HitTableList list) : BvhNode(list.objects, 0, list.objects.size())
+    {
+        // There's a C++ subtlety here. This constructor (without span indices) creates an
+        // implicit copy of the HitTable list, which we will modify. The lifetime of the copied
+        // list only extends until this constructor exits. That's OK, because we only need to
+        // persist the resulting bounding volume hierarchy.
+    }
+
+    BvhNode(std::vector<shared_ptr<HitTable>> &objects, size_t start, size_t end)
+    {
+        // Build the bounding box of the span of source objects.
+        for (size_t objectIndex = start; objectIndex < end; objectIndex++)
+        {
+            bbox = Aabb(bbox, objects[objectIndex]->BoundingBox());
+        }
+
+        size_t objectSpan = end - start;
+
+        if (objectSpan == 1)
+        {
+            left = objects[start];
+        }
+        else if (objectSpan == 2)
+        {
+            left = objects[start];
+            right = objects[start + 1];
+        }
+        else
+        {
+            auto first = objects.begin() + start;
+            auto last = objects.begin() + end;
+            auto split = SahPartition(first, last, [](const shared_ptr<HitTable> &object)
+            {
+                return object->BoundingBox();
+            });
+
+            auto mid = start + (split - first);
+            left = make_shared<BvhNode>(objects, start, mid);
+            right = make_shared<BvhNode>(objects, mid, end);
+        }
+    }
+
+    bool Hit(const Ray &r, Interval rayT, HitRecord &rec) const override
+    {
+        if (!bbox.Hit(r, rayT))
+        {
+            return false;
+        }
+
+        bool hitLeft = left->Hit(r, rayT, rec);
+        bool hitRight = right && right->Hit(r, Interval(rayT.min, hitLeft ? rec.t : rayT.max), rec);
+
+        return hitLeft || hitRight;
+    }
+
+    Aabb BoundingBox() const override
+    { return bbox; }
+
+private:
+    shared_ptr<HitTable> left;
+    shared_ptr<HitTable> right;     // Null for single-object leaves
+    Aabb bbox;
+};
+
+#endif
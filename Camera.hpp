@@ -4,20 +4,54 @@
 #include "RTweekend.hpp"
 #include "HitTable.hpp"
 #include "Material.hpp"
+#include "Image.hpp"
+#include "Denoiser.hpp"
+#include "Wavefront.hpp"
+#include "RenderStats.hpp"
+#include "Sampler.hpp"
+#include "SpaceFillingCurve.hpp"
+#include "ThreadPool.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
 #include <vector>
 #include <thread>
-#include <mutex>
-#include <sstream>
 #include <iostream>
-#include <fstream>
+#include <memory>
+
+// Rectangle of pixels [x0, x1) x [y0, y1) rendered as one unit of work.
+struct Tile
+{
+    int x0, y0, x1, y1;
+};
+
+// How Camera traces the paths of each tile.
+enum class Integrator
+{
+    Iterative,  // One path at a time, bounce by bounce
+    Wavefront   // Batches of paths advanced together, one stage at a time
+};
+
+// Where the uniform numbers of every pixel sample come from, see Sampler.hpp.
+enum class SamplerType
+{
+    Independent,    // Uncorrelated random numbers
+    Stratified,     // Each dimension stratified over the samples of a pixel
+    Sobol           // Owen scrambled Sobol points, the least noise per sample
+};
 
 class Camera
 {
 public:
     double aspectRatio = 1.0;                       // Ratio of image width over height
     int imageWidth = 100;                           // Rendered image width in pixel count
-    int samplesPerPixel = 10;                       // Count of random samples for each pixel
+    int samplesPerPixel = 10;                       // Count of random samples for each pixel (the maximum
+                                                    // when adaptive)
     int maxDepth = 10;                              // Maximum number of Ray bounces into scene
 
     double vFov = 90;                               // Vertical view angle (field of view)
@@ -28,8 +62,48 @@ public:
     double defocusAngle = 0;                        // Variation angle of rays through each pixel
     double focusDist = 10;                          // Distance from Camera lookFrom point to plane of perfect focus
 
-    std::vector<std::string> outputBuffer;          // Buffer to store output strings for each row
-    std::mutex coutMutex;                           // Mutex to synchronize console output for logging
+    double shutterOpen = 0;                         // Time the shutter opens, in [0, 1] where moving spheres are placed
+    double shutterClose = 1;                        // Time the shutter closes, equal to shutterOpen for no motion blur
+
+    uint64_t seed = 0;                              // Seed for the per-pixel random sequences
+
+    int tileSize = 16;                              // Width and height of the square tiles handed to threads
+    int threadCount = 0;                            // Number of render threads, 0 uses all hardware threads
+    TileOrder tileOrder = TileOrder::Morton;        // Order of the tiles, and of the pixels inside every tile
+
+    Integrator integrator = Integrator::Iterative;  // Path tracing strategy
+    int wavefrontSize = 4096;                       // Paths per batch for the wavefront integrator
+    bool sortRays = false;                          // Sort bounced wavefront paths by direction octant and origin cell
+    SamplerType sampler = SamplerType::Sobol;       // Source of the uniform numbers of every pixel sample
+
+    bool russianRoulette = true;                    // Randomly end paths whose throughput has become small
+    int rouletteMinDepth = 3;                       // Rays every path traces before Russian roulette may end it
+
+    bool adaptiveSampling = false;                  // Stop sampling a pixel once its noise is below
+                                                    // noiseThreshold (iterative integrator)
+    int minSamplesPerPixel = 32;                    // Samples every pixel takes before adaptive sampling may stop it
+    double noiseThreshold = 0.005;                  // Standard error of the displayed pixel luminance to stop at
+
+    double timeBudget = 0;                          // Wall-clock seconds for RenderProgressive, 0 for no limit
+    int snapshotInterval = 0;                       // Passes between two progressive snapshots, 0 for none
+
+    bool renderAovs = false;                        // Also record the first-hit albedo and normal of every pixel
+    bool denoise = false;                           // Filter frameBuffer guided by the first-hit buffers
+                                                    // (implies renderAovs)
+    DenoiseSettings denoiseSettings;                // Strength of the denoiser
+
+    bool verbose = true;                            // Log progress and render summaries to the console
+
+    Image frameBuffer;                              // Linear pixel colors of the last rendered frame
+    Image albedoBuffer;                             // Average albedo at the first hit of every pixel's camera rays
+    Image normalBuffer;                             // Average world space normal there, zero where rays miss
+    double denoiseSeconds = 0;                      // Time the denoiser took on the last frame
+    Image accumulation;                             // Sum of all progressive samples per pixel
+    int accumulatedSamples = 0;                     // Samples per pixel held in accumulation
+    std::vector<int> sampleCounts;                  // Samples taken by each pixel in the last render
+    WavefrontStats wavefrontStats;                  // Per-stage statistics of the last wavefront render
+    RenderStats renderStats;                        // Counters of the last render, summed over all threads
+    std::vector<TileTiming> tileTimings;            // Wall-clock span of every tile of the last render (RT_STATS only)
 
     std::vector<std::string> colors = {
             "\033[31m", // Red
@@ -49,85 +123,565 @@ public:
             "\033[97m"  // Bright White
     };
 
-    // Renders the scene into the given output file
-    void Render(const HitTable &world, std::ofstream &ppmFile)
+    // Height of the rendered image in pixels, following from imageWidth and aspectRatio.
+    int ImageHeight() const
+    {
+        return std::max(1, int(imageWidth / aspectRatio));
+    }
+
+    // Renders the scene into frameBuffer, and denoises it when denoise is set.
+    void Render(const HitTable &world, const MaterialTable &materials)
+    {
+        RenderRegion(world, materials, {0, 0, imageWidth, ImageHeight()});
+
+        if (denoise)
+        {
+            DenoiseFrame();
+            if (verbose)
+            {
+                std::cout << "Denoise time: " << 1000 * denoiseSeconds << " ms\n";
+            }
+        }
+    }
+
+    // Renders only the pixels inside region; the rest of frameBuffer keeps what it held, black when the
+    // buffer is new. Every pixel comes out exactly as in a full render, so regions rendered separately,
+    // for example by the worker processes of a distributed render, add up to the same image. Regions
+    // are never denoised, since the filter needs the neighbouring pixels.
+    void RenderRegion(const HitTable &world, const MaterialTable &materials, const Tile &region)
     {
         Initialize();
-        std::cout << "P3\n" << imageWidth << ' ' << imageHeight << "\n255\n";
-        ppmFile << "P3\n" << imageWidth << ' ' << imageHeight << "\n255\n";
 
-        outputBuffer.resize(imageHeight);
-        const int numThreads = std::thread::hardware_concurrency();
-        std::vector<std::thread> threads;
+        // The buffers are only reallocated when the image size changes, so a worker rendering many
+        // small regions doesn't clear a whole image for each of them.
+        auto resize = [&](Image &buffer, bool enabled)
+        {
+            if (!enabled)
+            {
+                buffer = Image();
+            }
+            else if (buffer.Width() != imageWidth || buffer.Height() != imageHeight)
+            {
+                buffer = Image(imageWidth, imageHeight);
+            }
+        };
+        resize(frameBuffer, true);
+        resize(albedoBuffer, AovsEnabled());
+        resize(normalBuffer, AovsEnabled());
+        sampleCounts.resize(size_t(imageWidth) * imageHeight);
+        for (int j = region.y0; j < region.y1; j++)
+        {
+            std::fill(sampleCounts.begin() + ptrdiff_t(j) * imageWidth + region.x0,
+                      sampleCounts.begin() + ptrdiff_t(j) * imageWidth + region.x1, samplesPerPixel);
+        }
+        wavefrontStats = WavefrontStats();
+        ResetStats();
+        BuildTiles(region);
+
+        std::vector<WavefrontBuffers> buffers(ThreadCount());
+        std::vector<WavefrontStats> stats(ThreadCount());
 
-        int rowsPerThread = imageHeight / numThreads;
+        RenderTiles([&](const Tile &tile, int threadNum)
+                    {
+                        WithSampler([&](auto tileSampler)
+                                    {
+                                        if (integrator == Integrator::Wavefront)
+                                        {
+                                            RenderTileWavefront(world, materials, tile, buffers[threadNum],
+                                                                stats[threadNum], tileSampler);
+                                        }
+                                        else
+                                        {
+                                            RenderTile(world, materials, tile, tileSampler);
+                                        }
+                                    });
+                    }, verbose);
 
-        for (int t = 0; t < numThreads; t++)
+        if (integrator == Integrator::Wavefront)
         {
-            int startRow = t * rowsPerThread;
-            int endRow = (t + 1) * rowsPerThread;
-            if (t == numThreads - 1)
+            for (const auto &threadStats: stats)
             {
-                endRow = imageHeight;  // Ensure the last thread covers all remaining rows
+                wavefrontStats.Merge(threadStats);
             }
+        }
+
+        if (!verbose)
+        {
+            return;
+        }
 
-            std::string threadColor = colors[t % colors.size()];
-            int threadNum = t;
+        std::clog << "\rDone.                 \n";
+        PrintStats();
 
-            threads.emplace_back([=, &world, &ppmFile]()
-                                 {
-                                     this->RenderSegment(world, ppmFile, startRow, endRow, threadColor, threadNum);
-                                 });
+        if (integrator == Integrator::Wavefront)
+        {
+            wavefrontStats.Print(std::cout);
         }
+        else if (adaptiveSampling)
+        {
+            uint64_t totalSamples = 0;
+            for (int count: sampleCounts)
+            {
+                totalSamples += count;
+            }
+            std::cout << "Adaptive sampling: " << double(totalSamples) / sampleCounts.size()
+                      << " samples per pixel on average (maximum " << samplesPerPixel << ")\n";
+        }
+    }
 
-        for (auto &thread: threads)
+    // Renders the scene one sample per pixel at a time into the accumulation buffer, until it holds
+    // samplesPerPixel samples or the next pass would overrun timeBudget. Passes only add to the
+    // accumulation buffer: frameBuffer is resolved from it every snapshotInterval passes, right before
+    // onSnapshot(frameBuffer, samples) is called, and once more when the render ends, so in between it
+    // holds the last snapshot (or the previous render). A buffer restored with LoadAccumulation() is
+    // continued rather than restarted, and because every pass is seeded by its sample index the result
+    // is the same as one uninterrupted render. The first-hit buffers aren't saved with the accumulation
+    // buffer, so they average the passes of this call only, and every resolved frame is denoised when
+    // denoise is set.
+    void RenderProgressive(const HitTable &world, const MaterialTable &materials,
+                           const std::function<void(const Image &, int)> &onSnapshot = {})
+    {
+        Initialize();
+
+        if (accumulation.Width() != imageWidth || accumulation.Height() != imageHeight)
         {
-            thread.join();
+            accumulation = Image(imageWidth, imageHeight);
+            accumulatedSamples = 0;
         }
+        albedoAccumulation = AovsEnabled() ? Image(imageWidth, imageHeight) : Image();
+        normalAccumulation = AovsEnabled() ? Image(imageWidth, imageHeight) : Image();
+        aovSamples = 0;
+        ResetStats();
+        BuildTiles({0, 0, imageWidth, imageHeight});
+
+        auto start = std::chrono::steady_clock::now();
+        double lastPassSeconds = 0;
+        int passes = 0;
 
-        for (const auto &line: outputBuffer)
+        while (accumulatedSamples < samplesPerPixel)
         {
-            ppmFile << line;
+            double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (timeBudget > 0 && accumulatedSamples > 0 && elapsed + lastPassSeconds > timeBudget)
+            {
+                break;
+            }
+
+            int sample = accumulatedSamples;
+            RenderTiles([&](const Tile &tile, int)
+                        {
+                            WithSampler([&](auto tileSampler)
+                                        {
+                                            RenderPassTile(world, materials, tile, sample, tileSampler);
+                                        });
+                        }, false);
+            accumulatedSamples++;
+            aovSamples += AovsEnabled();
+            passes++;
+
+            lastPassSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() - elapsed;
+            if (verbose)
+            {
+                std::clog << "\rPass " << accumulatedSamples << "/" << samplesPerPixel << " (" << lastPassSeconds
+                          << " s)" << std::flush;
+            }
+
+            if (onSnapshot && snapshotInterval > 0 && passes % snapshotInterval == 0)
+            {
+                ResolveAccumulation();
+                onSnapshot(frameBuffer, accumulatedSamples);
+            }
         }
 
-        std::clog << "\rDone.                 \n";
+        ResolveAccumulation();
+        if (verbose)
+        {
+            std::clog << "\rDone: " << accumulatedSamples << " samples per pixel.                 \n";
+            PrintStats();
+            if (denoise)
+            {
+                std::cout << "Denoise time: " << 1000 * denoiseSeconds << " ms\n";
+            }
+        }
     }
 
-    void
-    RenderSegment(const HitTable &world, std::ofstream &ppmFile, int startRow, int endRow, const std::string &color,
-                  int threadNum)
+    // Writes the accumulation buffer with its sample count, so a progressive render can be resumed.
+    void SaveAccumulation(const std::string &path) const
     {
-        int totalRows = endRow - startRow;
-        int logFrequency = totalRows / 10;  // Update progress every 10% of the segment processed
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+        {
+            throw std::runtime_error("Failed to open " + path + " for writing.");
+        }
 
-        for (int j = startRow; j < endRow; j++)
+        AccumulationHeader header = MakeAccumulationHeader();
+        file.write(AccumulationMagic, sizeof(AccumulationMagic));
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(accumulation.Data()),
+                   std::streamsize(size_t(accumulation.Width()) * accumulation.Height() * 3 * sizeof(float)));
+    }
+
+    // Restores an accumulation buffer written by SaveAccumulation(). The image size, seed, sampler,
+    // integrator, maximum depth and Russian roulette settings must match the Camera, otherwise the
+    // continued passes would sample a different estimator than the saved ones. The stratified sampler
+    // also needs the same samplesPerPixel, which sets its strata.
+    void LoadAccumulation(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
         {
-            std::stringstream localOutput;
-            for (int i = 0; i < imageWidth; i++)
+            throw std::runtime_error("Failed to open " + path + " for reading.");
+        }
+
+        char magic[sizeof(AccumulationMagic)];
+        AccumulationHeader header;
+        file.read(magic, sizeof(magic));
+        file.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (!file || std::memcmp(magic, AccumulationMagic, sizeof(magic)) != 0)
+        {
+            throw std::runtime_error(path + " is not an accumulation buffer.");
+        }
+
+        Initialize();
+        AccumulationHeader expected = MakeAccumulationHeader();
+        expected.width = imageWidth;
+        expected.height = imageHeight;
+        expected.samples = header.samples;
+        if (header.sampler == expected.sampler && header.strata != expected.strata)
+        {
+            throw std::runtime_error(path + " was rendered with the stratified sampler at "
+                                     + std::to_string(header.strata) + " samples per pixel, which set its "
+                                     "strata; resume it with the same samples per pixel.");
+        }
+        if (header != expected)
+        {
+            throw std::runtime_error(path + " was rendered with a different image size, seed, sampler, integrator, "
+                                            "maximum depth or Russian roulette setting.");
+        }
+
+        accumulation = Image(header.width, header.height);
+        accumulatedSamples = header.samples;
+        file.read(reinterpret_cast<char *>(accumulation.Data()),
+                  std::streamsize(size_t(header.width) * header.height * 3 * sizeof(float)));
+        if (!file)
+        {
+            throw std::runtime_error(path + " is truncated.");
+        }
+    }
+
+    template<Sampler S>
+    void RenderTile(const HitTable &world, const MaterialTable &materials, const Tile &tile, S sampler)
+    {
+        for (auto offset: pixelOrder)
+        {
+            int i = tile.x0 + offset.x;
+            int j = tile.y0 + offset.y;
+            if (i < tile.x1 && j < tile.y1)
             {
                 Color pixelColor(0, 0, 0);
-                for (int sample = 0; sample < samplesPerPixel; sample++)
+                FirstHit features;
+                int sampleCount = 0;
+                double mean = 0, m2 = 0;    // Running luminance mean and sum of squared deviations (Welford)
+
+                while (sampleCount < samplesPerPixel)
+                {
+                    sampler.StartPixelSample(uint64_t(j) * imageWidth + i, uint32_t(sampleCount));
+                    Ray r = GetRay(i, j, sampler);
+                    Color sampleColor = RayColor(r, maxDepth, world, materials, sampler,
+                                                 AovsEnabled() ? &features : nullptr);
+                    pixelColor += sampleColor;
+                    sampleCount++;
+
+                    if (adaptiveSampling)
+                    {
+                        double luminance = Luminance(sampleColor);
+                        double delta = luminance - mean;
+                        mean += delta / sampleCount;
+                        m2 += delta * (luminance - mean);
+
+                        if (sampleCount >= minSamplesPerPixel && sampleCount % AdaptiveCheckInterval == 0
+                            && Converged(mean, m2, sampleCount))
+                        {
+                            break;
+                        }
+                    }
+                }
+
+                frameBuffer.SetPixel(i, j, pixelColor / sampleCount);
+                sampleCounts[size_t(j) * imageWidth + i] = sampleCount;
+                if (AovsEnabled())
                 {
-                    Ray r = GetRay(i, j);
-                    pixelColor += RayColor(r, maxDepth, world);
+                    albedoBuffer.SetPixel(i, j, features.albedo / sampleCount);
+                    normalBuffer.SetPixel(i, j, features.normal / sampleCount);
                 }
-                localOutput << WriteColor(pixelSamplesScale * pixelColor);
             }
-            outputBuffer[j] = localOutput.str();
+        }
+    }
 
-            if ((j - startRow) % logFrequency == 0)
+    // Adds one sample, the one with index sample, to every pixel of the tile in the accumulation buffer.
+    template<Sampler S>
+    void RenderPassTile(const HitTable &world, const MaterialTable &materials, const Tile &tile, int sample,
+                        S sampler)
+    {
+        for (auto offset: pixelOrder)
+        {
+            int i = tile.x0 + offset.x;
+            int j = tile.y0 + offset.y;
+            if (i < tile.x1 && j < tile.y1)
             {
-                std::lock_guard<std::mutex> guard(coutMutex);
-                std::cout << color << "Thread " << threadNum << " processing rows " << startRow << " to " << endRow
-                          << ": Completed " << (j - startRow + 1) << " out of " << totalRows
-                          << " rows." << "\033[0m" << std::endl;
+                sampler.StartPixelSample(uint64_t(j) * imageWidth + i, uint32_t(sample));
+                Ray r = GetRay(i, j, sampler);
+                FirstHit features;
+                accumulation.AddPixel(i, j, RayColor(r, maxDepth, world, materials, sampler,
+                                                     AovsEnabled() ? &features : nullptr));
+                if (AovsEnabled())
+                {
+                    albedoAccumulation.AddPixel(i, j, features.albedo);
+                    normalAccumulation.AddPixel(i, j, features.normal);
+                }
+            }
+        }
+    }
+
+    // Samples taken per pixel mapped from black (minSamplesPerPixel or fewer) through red and yellow
+    // to white (samplesPerPixel).
+    Image SampleHeatmap() const
+    {
+        Image heatmap(imageWidth, imageHeight);
+        int low = adaptiveSampling ? std::min(minSamplesPerPixel, samplesPerPixel) : 0;
+        double range = std::max(1, samplesPerPixel - low);
+
+        for (int j = 0; j < imageHeight; j++)
+        {
+            for (int i = 0; i < imageWidth; i++)
+            {
+                double x = std::clamp((sampleCounts[size_t(j) * imageWidth + i] - low) / range, 0.0, 1.0);
+                heatmap.SetPixel(i, j, Color(std::min(1.0, 3 * x),
+                                             std::clamp(3 * x - 1, 0.0, 1.0),
+                                             std::clamp(3 * x - 2, 0.0, 1.0)));
+            }
+        }
+        return heatmap;
+    }
+
+    // Renders a tile by advancing batches of up to wavefrontSize paths one stage at a time: generate
+    // camera rays, intersect all of them, group them by material, scatter, and compact the survivors.
+    template<Sampler S>
+    void RenderTileWavefront(const HitTable &world, const MaterialTable &materials, const Tile &tile,
+                             WavefrontBuffers &buffers, WavefrontStats &stats, S sampler)
+    {
+        const int tileWidth = tile.x1 - tile.x0;
+        const int pixelCount = tileWidth * (tile.y1 - tile.y0);
+        const int samplesPerBatch = std::max(1, wavefrontSize / pixelCount);
+
+        auto &paths = buffers.paths;
+        auto &hits = buffers.hits;
+        auto &order = buffers.order;
+        buffers.radiance.assign(pixelCount, Color(0, 0, 0));
+        if (AovsEnabled())
+        {
+            buffers.albedo.assign(pixelCount, Color(0, 0, 0));
+            buffers.normal.assign(pixelCount, Vec3(0, 0, 0));
+        }
+
+        for (int firstSample = 0; firstSample < samplesPerPixel; firstSample += samplesPerBatch)
+        {
+            const int lastSample = std::min(samplesPerPixel, firstSample + samplesPerBatch);
+            StageTimer timer;
+
+            paths.clear();
+            for (auto offset: pixelOrder)
+            {
+                int i = tile.x0 + offset.x;
+                int j = tile.y0 + offset.y;
+                if (i >= tile.x1 || j >= tile.y1)
+                {
+                    continue;
+                }
+                int p = offset.y * tileWidth + offset.x;
+                uint64_t pixelIndex = uint64_t(j) * imageWidth + i;
+
+                for (int sample = firstSample; sample < lastSample; sample++)
+                {
+                    sampler.StartPixelSample(pixelIndex, uint32_t(sample));
+                    Ray r = GetRay(i, j, sampler);
+                    paths.push_back({r, Color(1, 1, 1), uint32_t(sample), uint32_t(p), true, AovsEnabled()});
+                }
+            }
+            stats.Add(WavefrontStage::Generate, paths.size(), timer.Lap());
+
+            for (int depth = 0; depth < maxDepth && !paths.empty(); depth++)
+            {
+                const size_t liveCount = paths.size();
+                threadStats.raysPerDepth[std::min(depth, MaxStatsDepth - 1)] += liveCount;
+
+                hits.resize(liveCount);
+                for (size_t k = 0; k < liveCount; k++)
+                {
+                    auto &path = paths[k];
+                    if (!world.Hit(path.ray, Interval(0, RT_INFINITY), hits[k]))
+                    {
+                        buffers.radiance[path.pixel] += path.throughput * Background(path.ray);
+                        path.alive = false;
+                    }
+                }
+                if (AovsEnabled())
+                {
+                    for (size_t k = 0; k < liveCount; k++)
+                    {
+                        auto &path = paths[k];
+                        if (path.guidesPending && (!path.alive || !IsSpecular(materials[hits[k].mat])))
+                        {
+                            buffers.albedo[path.pixel] += path.throughput * (path.alive ? Albedo(materials[hits[k].mat])
+                                                                                        : Background(path.ray));
+                            if (path.alive)
+                            {
+                                buffers.normal[path.pixel] += hits[k].normal;
+                            }
+                            path.guidesPending = false;
+                        }
+                    }
+                }
+                stats.Add(WavefrontStage::Intersect, liveCount, timer.Lap());
+
+                // Counting sort of the paths that hit something by material alternative.
+                constexpr size_t typeCount = std::variant_size_v<Material>;
+                size_t typeStart[typeCount + 1] = {};
+                for (size_t k = 0; k < liveCount; k++)
+                {
+                    if (paths[k].alive)
+                    {
+                        typeStart[materials[hits[k].mat].index() + 1]++;
+                    }
+                }
+                for (size_t t = 0; t < typeCount; t++)
+                {
+                    typeStart[t + 1] += typeStart[t];
+                }
+                order.resize(typeStart[typeCount]);
+                for (size_t k = 0; k < liveCount; k++)
+                {
+                    if (paths[k].alive)
+                    {
+                        order[typeStart[materials[hits[k].mat].index()]++] = uint32_t(k);
+                    }
+                }
+                stats.Add(WavefrontStage::Sort, liveCount, timer.Lap());
+
+                for (uint32_t k: order)
+                {
+                    auto &path = paths[k];
+                    Ray scattered;
+                    Color attenuation;
+
+                    int i = tile.x0 + int(path.pixel) % tileWidth;
+                    int j = tile.y0 + int(path.pixel) / tileWidth;
+                    sampler.StartPixelSample(uint64_t(j) * imageWidth + i, path.sample);
+                    auto u = NextScatterSample(sampler, depth);
+
+                    if (Scatter(materials[hits[k].mat], path.ray, hits[k], u, attenuation, scattered))
+                    {
+                        path.ray = scattered;
+                        path.throughput = path.throughput * attenuation;
+                        path.alive = SurvivesRoulette(path.throughput, depth + 1, sampler.Get1D());
+                    }
+                    else
+                    {
+                        path.alive = false;
+                    }
+                }
+                stats.Add(WavefrontStage::Scatter, order.size(), timer.Lap());
+
+                // Survivors are kept in material order, so the next batch stays grouped as well.
+                buffers.survivors.clear();
+                for (uint32_t k: order)
+                {
+                    if (paths[k].alive)
+                    {
+                        buffers.survivors.push_back(paths[k]);
+                    }
+                }
+                paths.swap(buffers.survivors);
+                stats.Add(WavefrontStage::Compact, order.size(), timer.Lap());
+
+                if (sortRays && paths.size() > 1)
+                {
+                    SortByCoherence(buffers);
+                    stats.Add(WavefrontStage::Reorder, paths.size(), timer.Lap());
+                }
+            }
+        }
+
+        for (int p = 0; p < pixelCount; p++)
+        {
+            int i = tile.x0 + p % tileWidth;
+            int j = tile.y0 + p / tileWidth;
+            frameBuffer.SetPixel(i, j, pixelSamplesScale * buffers.radiance[p]);
+            if (AovsEnabled())
+            {
+                albedoBuffer.SetPixel(i, j, pixelSamplesScale * buffers.albedo[p]);
+                normalBuffer.SetPixel(i, j, pixelSamplesScale * buffers.normal[p]);
             }
         }
     }
 
 private:
+    static constexpr int AdaptiveCheckInterval = 8;     // Samples between two convergence checks
+    static constexpr std::chrono::milliseconds ProgressInterval{50};    // Between two progress checks
+
+    // Sampler dimensions of a pixel sample: two for the position inside the pixel, two for the point
+    // on the lens, one for the time, then DimensionsPerBounce for every bounce (a direction, a discrete
+    // choice and the Russian roulette decision).
+    static constexpr int PixelDimension = 0;
+    static constexpr int LensDimension = 2;
+    static constexpr int TimeDimension = 4;
+    static constexpr int BounceDimension = 5;
+    static constexpr int DimensionsPerBounce = 4;
+    static constexpr char AccumulationMagic[8] = {'R', 'T', 'A', 'C', 'C', 'U', 'M', '2'};
+
+    // Header of a saved accumulation buffer: its size and sample count, and every setting that picks
+    // the estimator its passes sample, so a resumed render can only continue the same one.
+    struct AccumulationHeader
+    {
+        int32_t width, height;
+        int32_t samples;
+        int32_t realSize;           // sizeof(Real); float and double builds trace slightly different paths
+        int32_t maxDepth;
+        int32_t sampler, integrator;
+        int32_t russianRoulette, rouletteMinDepth;
+        int32_t strata;             // samplesPerPixel for the stratified sampler, whose strata follow it
+        uint64_t seed;
+
+        bool operator==(const AccumulationHeader &) const = default;
+    };
+
+    AccumulationHeader MakeAccumulationHeader() const
+    {
+        AccumulationHeader header{};
+        header.width = accumulation.Width();
+        header.height = accumulation.Height();
+        header.samples = accumulatedSamples;
+        header.realSize = sizeof(Real);
+        header.maxDepth = maxDepth;
+        header.sampler = int32_t(sampler);
+        header.integrator = int32_t(integrator);
+        header.russianRoulette = russianRoulette;
+        header.rouletteMinDepth = rouletteMinDepth;
+        header.strata = sampler == SamplerType::Stratified ? samplesPerPixel : 0;
+        header.seed = seed;
+        return header;
+    }
+
+    // Denoiser guides of a camera path, summed over the samples of a pixel: the albedo, times the
+    // attenuation so far, and the normal at its first hit that isn't specular, or the background
+    // color if it escapes before one.
+    struct FirstHit
+    {
+        Color albedo = Color(0, 0, 0);
+        Vec3 normal = Vec3(0, 0, 0);
+    };
+
     int imageHeight;            // Rendered image height
-    double pixelSamplesScale;   // Color scale factor for a sum of pixel samples
+    Real pixelSamplesScale;     // Color scale factor for a sum of pixel samples
     Point3 center;              // Camera center
     Point3 pixel00Loc;          // Location of pixel 0, 0
     Vec3 pixelDeltaU;           // Offset to pixel to the right
@@ -135,13 +689,25 @@ private:
     Vec3 u, v, w;               // Camera frame basis vectors
     Vec3 defocusDiskU;          // Defocus disk horizontal radius
     Vec3 defocusDiskV;          // Defocus disk vertical radius
+    std::vector<Tile> tiles;    // Image tiles in the order they are handed out
+    std::vector<GridCell> pixelOrder;   // Pixel offsets inside a full tile, in the order they are rendered
+    std::chrono::steady_clock::time_point renderStart;  // Origin of the tile timings
+    std::unique_ptr<ThreadPool> threadPool;             // Render threads, kept alive between renders
+    Image albedoAccumulation;   // Sums of the first-hit buffers over the progressive passes
+    Image normalAccumulation;
+    int aovSamples = 0;         // Passes summed in them
 
     void Initialize()
     {
-        imageHeight = int(imageWidth / aspectRatio);
-        imageHeight = (imageHeight < 1) ? 1 : imageHeight;
+        // Moving spheres are bounded over times in [0, 1] only; a Ray outside it could miss them.
+        if (!(0 <= shutterOpen && shutterOpen <= 1 && 0 <= shutterClose && shutterClose <= 1))
+        {
+            throw std::runtime_error("The shutter times must lie in [0, 1].");
+        }
 
-        pixelSamplesScale = 1.0 / samplesPerPixel;
+        imageHeight = ImageHeight();
+
+        pixelSamplesScale = Real(1) / samplesPerPixel;
 
         center = lookFrom;
 
@@ -174,53 +740,386 @@ private:
         defocusDiskV = v * defocusRadius;
     }
 
-    Ray GetRay(int i, int j) const
+    int ThreadCount() const
+    {
+        int numThreads = threadCount > 0 ? threadCount : int(std::thread::hardware_concurrency());
+        return std::max(1, numThreads);
+    }
+
+    bool AovsEnabled() const
+    {
+        return renderAovs || denoise;
+    }
+
+    // The render threads, started on first use or when threadCount has changed.
+    ThreadPool &Pool()
+    {
+        if (!threadPool || threadPool->Size() != ThreadCount())
+        {
+            threadPool = std::make_unique<ThreadPool>(ThreadCount());
+        }
+        return *threadPool;
+    }
+
+    // Replaces frameBuffer by its denoised version, filtered on the render threads.
+    void DenoiseFrame()
+    {
+        auto start = std::chrono::steady_clock::now();
+        Denoise(frameBuffer, albedoBuffer, normalBuffer, denoiseSettings, Pool());
+        denoiseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Runs renderTile(tile, threadNum) for every tile on the ThreadCount() threads of the pool. Threads
+    // pull tiles from a shared atomic counter until none are left, so expensive tiles never leave other
+    // cores idle at the end of the frame. Workers never lock or print: they count finished tiles in an
+    // atomic that this thread reports from, and keep their statistics to themselves until the job ends.
+    template<typename TileFunction>
+    void RenderTiles(TileFunction &&renderTile, bool logProgress)
+    {
+        std::atomic<size_t> nextTile = 0;
+        std::atomic<size_t> completedTiles = 0;
+
+        const int numThreads = ThreadCount();
+        ThreadPool &pool = Pool();
+
+        std::vector<RenderStats> stats(numThreads);
+        std::vector<std::vector<TileTiming>> timings(numThreads);
+
+        pool.Start([&](int t)
+                          {
+                              threadStats = RenderStats();
+
+                              for (size_t index = nextTile++; index < tiles.size(); index = nextTile++)
+                              {
+                                  const Tile &tile = tiles[index];
+                                  RT_STAT(double start = SecondsSinceRenderStart());
+                                  renderTile(tile, t);
+                                  RT_STAT(timings[t].push_back({t, tile.x0, tile.y0, tile.x1, tile.y1, start,
+                                                                SecondsSinceRenderStart()}));
+                                  completedTiles.fetch_add(1, std::memory_order_relaxed);
+                              }
+
+                              stats[t] = threadStats;
+                          });
+
+        if (logProgress)
+        {
+            ReportProgress(completedTiles);
+        }
+        pool.Wait();
+
+        for (int t = 0; t < numThreads; t++)
+        {
+            renderStats.Merge(stats[t]);
+            tileTimings.insert(tileTimings.end(), timings[t].begin(), timings[t].end());
+        }
+    }
+
+    // Prints the share of finished tiles until all are done, polling instead of waiting on the workers.
+    void ReportProgress(const std::atomic<size_t> &completedTiles) const
+    {
+        int lastPercent = -1;
+        while (true)
+        {
+            size_t done = completedTiles.load(std::memory_order_relaxed);
+            int percent = tiles.empty() ? 100 : int(done * 100 / tiles.size());
+            if (percent != lastPercent)
+            {
+                std::clog << "\rRendering: " << percent << "%" << std::flush;
+                lastPercent = percent;
+            }
+            if (done >= tiles.size())
+            {
+                return;
+            }
+            std::this_thread::sleep_for(ProgressInterval);
+        }
+    }
+
+    void ResetStats()
+    {
+        renderStats = RenderStats();
+        tileTimings.clear();
+        renderStart = std::chrono::steady_clock::now();
+    }
+
+    double SecondsSinceRenderStart() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - renderStart).count();
+    }
+
+    // Summary of the merged counters, and with RT_STATS the time spent on tiles by every thread.
+    void PrintStats() const
+    {
+        renderStats.Print(std::cout);
+        if (tileTimings.empty())
+        {
+            return;
+        }
+
+        double total = 0;
+        double longest = 0;
+        std::vector<double> busy(ThreadCount(), 0);
+        std::vector<int> tileCounts(ThreadCount(), 0);
+        for (const auto &timing: tileTimings)
+        {
+            total += timing.Seconds();
+            longest = std::max(longest, timing.Seconds());
+            busy[timing.thread] += timing.Seconds();
+            tileCounts[timing.thread]++;
+        }
+
+        std::cout << "Tiles: " << tileTimings.size() << ", " << 1000 * total / tileTimings.size()
+                  << " ms on average, " << 1000 * longest << " ms the longest\n";
+        for (size_t t = 0; t < busy.size(); t++)
+        {
+            std::cout << colors[t % colors.size()] << "Thread " << t << ": " << tileCounts[t] << " tiles in "
+                      << busy[t] << " s" << "\033[0m\n";
+        }
+    }
+
+    // Calls render(sampler) with a sampler of the selected type, so that render is compiled once per
+    // type and the sampler calls inline.
+    template<typename RenderFunction>
+    void WithSampler(RenderFunction &&render) const
+    {
+        switch (sampler)
+        {
+            case SamplerType::Independent:
+                render(IndependentSampler(seed, samplesPerPixel));
+                break;
+            case SamplerType::Stratified:
+                render(StratifiedSampler(seed, samplesPerPixel));
+                break;
+            case SamplerType::Sobol:
+                render(SobolSampler(seed, samplesPerPixel));
+                break;
+        }
+    }
+
+    void ResolveAccumulation()
+    {
+        frameBuffer = Image(imageWidth, imageHeight);
+        sampleCounts.assign(size_t(imageWidth) * imageHeight, accumulatedSamples);
+
+        double scale = accumulatedSamples > 0 ? 1.0 / accumulatedSamples : 0;
+        for (int j = 0; j < imageHeight; j++)
+        {
+            for (int i = 0; i < imageWidth; i++)
+            {
+                frameBuffer.SetPixel(i, j, scale * accumulation.GetPixel(i, j));
+            }
+        }
+
+        if (!AovsEnabled())
+        {
+            albedoBuffer = normalBuffer = Image();
+            return;
+        }
+
+        albedoBuffer = Image(imageWidth, imageHeight);
+        normalBuffer = Image(imageWidth, imageHeight);
+        double aovScale = aovSamples > 0 ? 1.0 / aovSamples : 0;
+        for (int j = 0; j < imageHeight; j++)
+        {
+            for (int i = 0; i < imageWidth; i++)
+            {
+                albedoBuffer.SetPixel(i, j, aovScale * albedoAccumulation.GetPixel(i, j));
+                normalBuffer.SetPixel(i, j, aovScale * normalAccumulation.GetPixel(i, j));
+            }
+        }
+        if (denoise)
+        {
+            DenoiseFrame();
+        }
+    }
+
+    // Splits region, clipped to the image, into tiles of tileSize pixels, ordered along tileOrder.
+    // Tiles close in the order are close on screen, so the threads pulling consecutive tiles share
+    // the scene data their rays touch.
+    void BuildTiles(const Tile &region)
     {
-        auto offset = SampleSquare();
+        int size = std::max(1, tileSize);
+        int x0 = std::max(0, region.x0);
+        int y0 = std::max(0, region.y0);
+        int x1 = std::min(region.x1, imageWidth);
+        int y1 = std::min(region.y1, imageHeight);
+        int columns = std::max(0, (x1 - x0 + size - 1) / size);
+        int rows = std::max(0, (y1 - y0 + size - 1) / size);
+
+        tiles.clear();
+        for (auto cell: CurveOrder(tileOrder, columns, rows))
+        {
+            int tileX = x0 + cell.x * size;
+            int tileY = y0 + cell.y * size;
+            tiles.push_back({tileX, tileY, std::min(tileX + size, x1), std::min(tileY + size, y1)});
+        }
+        pixelOrder = CurveOrder(tileOrder, size, size);
+    }
+
+    template<Sampler S>
+    Ray GetRay(int i, int j, S &sampler) const
+    {
+        sampler.SetDimension(PixelDimension);
+        auto offset = SampleSquare(sampler.Get2D());
         auto pixelSample = pixel00Loc
                            + ((i + offset.X()) * pixelDeltaU)
                            + ((j + offset.Y()) * pixelDeltaV);
 
-        auto rayOrigin = (defocusAngle <= 0) ? center : DefocusDiskSample();
+        sampler.SetDimension(LensDimension);
+        auto rayOrigin = (defocusAngle <= 0) ? center : DefocusDiskSample(sampler.Get2D());
         auto rayDirection = pixelSample - rayOrigin;
 
-        return Ray(rayOrigin, rayDirection);
+        sampler.SetDimension(TimeDimension);
+        auto rayTime = Real(shutterOpen + (shutterClose - shutterOpen) * sampler.Get1D());
+
+        return Ray(rayOrigin, rayDirection, rayTime);
     }
 
-    Vec3 SampleSquare() const
+    static Vec3 SampleSquare(Sample2D u)
     {
-        return Vec3(RandomDouble() - 0.5, RandomDouble() - 0.5, 0);
+        return Vec3(u.x - Real(0.5), u.y - Real(0.5), 0);
     }
 
-    Point3 DefocusDiskSample() const
+    Point3 DefocusDiskSample(Sample2D u) const
     {
-        auto p = RandomInUnitDisk();
+        auto p = SampleConcentricDisk(u.x, u.y);
         return center + (p[0] * defocusDiskU) + (p[1] * defocusDiskV);
     }
 
-    Color RayColor(const Ray &r, int depth, const HitTable &world) const
+    template<Sampler S>
+    static ScatterSample NextScatterSample(S &sampler, int bounce)
     {
-        if (depth <= 0)
+        sampler.SetDimension(BounceDimension + DimensionsPerBounce * bounce);
+        auto direction = sampler.Get2D();
+        return {direction.x, direction.y, sampler.Get1D()};
+    }
+
+    // Russian roulette for the ray about to be traced at the given depth. From rouletteMinDepth on the
+    // path continues with probability equal to its largest throughput component, and survivors are
+    // divided by that probability, so the estimate stays unbiased while paths that can no longer add
+    // much light stop early. u is the uniform number deciding it.
+    bool SurvivesRoulette(Color &throughput, int depth, Real u) const
+    {
+        if (!russianRoulette || depth < rouletteMinDepth)
+        {
+            return true;
+        }
+
+        Real survival = std::min(Real(1), MaxComponent(throughput));
+        if (u >= survival)
         {
-            return Color(0, 0, 0);
+            threadStats.rouletteTerminations++;
+            return false;
         }
+        throughput = throughput / survival;
+        return true;
+    }
 
-        HitRecord rec;
+    // Color the path starting with Ray r carries back. Its denoiser guides are added to firstHit when
+    // given.
+    template<Sampler S>
+    Color RayColor(const Ray &r, int depth, const HitTable &world, const MaterialTable &materials, S &sampler,
+                   FirstHit *firstHit = nullptr) const
+    {
+        Ray ray = r;
+        Color throughput(1, 1, 1);
 
-        if (world.Hit(r, Interval(0.001, RT_INFINITY), rec))
+        for (int bounce = 0; bounce < depth; bounce++)
         {
+            HitRecord rec;
+            threadStats.CountRay(bounce);
+
+            bool hit = world.Hit(ray, Interval(0, RT_INFINITY), rec);
+            if (firstHit && (!hit || !IsSpecular(materials[rec.mat])))
+            {
+                firstHit->albedo += throughput * (hit ? Albedo(materials[rec.mat]) : Background(ray));
+                if (hit)
+                {
+                    firstHit->normal += rec.normal;
+                }
+                firstHit = nullptr;
+            }
+            if (!hit)
+            {
+                return throughput * Background(ray);
+            }
+
             Ray scattered;
             Color attenuation;
-            if (rec.mat->Scatter(r, rec, attenuation, scattered))
+            auto u = NextScatterSample(sampler, bounce);
+            if (!Scatter(materials[rec.mat], ray, rec, u, attenuation, scattered))
             {
-                return attenuation * RayColor(scattered, depth - 1, world);
+                return Color(0, 0, 0);
             }
-            return Color(0, 0, 0);
+
+            throughput = throughput * attenuation;
+            if (!SurvivesRoulette(throughput, bounce + 1, sampler.Get1D()))
+            {
+                return Color(0, 0, 0);
+            }
+            ray = scattered;
         }
 
+        // Exceeded the Ray bounce limit, no more light is gathered.
+        return Color(0, 0, 0);
+    }
+
+    bool Converged(double mean, double m2, int sampleCount) const
+    {
+        // Standard error of the mean luminance, carried through the gamma 2 output transform
+        // (d sqrt(x) = dx / (2 sqrt(x))), so every pixel stops at the same visible noise level.
+        double variance = m2 / (sampleCount - 1);
+        double standardError = sqrt(variance / sampleCount);
+        return standardError <= noiseThreshold * 2 * sqrt(std::max(mean, 1e-4));
+    }
+
+    // Reorders the live paths so that rays leaving from nearby points in similar directions are
+    // intersected one after another and walk the same hierarchy nodes: sorted by direction octant,
+    // then by the Z-order cell of the origin in a 2^9 grid over the bounds of all origins.
+    static void SortByCoherence(WavefrontBuffers &buffers)
+    {
+        auto &paths = buffers.paths;
+        Aabb bounds = Aabb::empty;
+        for (const auto &path: paths)
+        {
+            bounds = Aabb(bounds, Aabb(path.ray.origin(), path.ray.origin()));
+        }
+
+        constexpr int CellBits = 9;
+        auto cell = [&](int axis, Real x)
+        {
+            const Interval &range = bounds.AxisInterval(axis);
+            Real scale = range.Size() > 0 ? ((1 << CellBits) - 1) / range.Size() : 0;
+            return uint32_t((x - range.min) * scale);
+        };
+
+        // The key in the high half and the path index in the low one, so one integer sort does it.
+        auto &keys = buffers.keys;
+        keys.resize(paths.size());
+        for (size_t k = 0; k < paths.size(); k++)
+        {
+            const Point3 &o = paths[k].ray.origin();
+            const Vec3 &d = paths[k].ray.direction();
+            uint32_t octant = (d.X() < 0) | (d.Y() < 0) << 1 | (d.Z() < 0) << 2;
+            uint32_t key = octant << (3 * CellBits) | MortonCode3(cell(0, o.X()), cell(1, o.Y()), cell(2, o.Z()));
+            keys[k] = uint64_t(key) << 32 | k;
+        }
+        std::sort(keys.begin(), keys.end());
+
+        buffers.survivors.clear();
+        for (auto key: keys)
+        {
+            buffers.survivors.push_back(paths[uint32_t(key)]);
+        }
+        paths.swap(buffers.survivors);
+    }
+
+    static Color Background(const Ray &r)
+    {
         Vec3 unitDirection = UnitVector(r.direction());
-        auto a = 0.5 * (unitDirection.Y() + 1.0);
-        return (1.0 - a) * Color(1.0, 1.0, 1.0) + a * Color(0.5, 0.7, 1.0);
+        auto a = Real(0.5) * (unitDirection.Y() + 1);
+        return (1 - a) * Color(1.0, 1.0, 1.0) + a * Color(0.5, 0.7, 1.0);
     }
 };
 
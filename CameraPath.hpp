@@ -0,0 +1,143 @@
+#ifndef CAMERA_PATH_H
+#define CAMERA_PATH_H
+
+#include "RTweekend.hpp"
+#include "Camera.hpp"
+#include "SceneFile.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Camera settings at one point in time of an animation.
+struct CameraKeyframe
+{
+    double time;
+    Point3 lookFrom;
+    Point3 lookAt;
+    double vFov;
+    double focusDist;
+};
+
+// Keyframed camera fly-through. Positions follow a Catmull-Rom spline through the keyframes, so the
+// camera moves without sudden changes of direction at a keyframe; the field of view and the focus
+// distance are interpolated linearly. Before the first and after the last keyframe the camera holds
+// still.
+//
+// Camera path files have one keyframe per line, '#' starting a comment:
+//
+//     # time  look_from  look_at  vfov  focus_distance
+//     key 0   13 2 3     0 0 0    20    10
+//     key 4   0 3 12     0 0 0    30    12
+class CameraPath
+{
+public:
+    void Add(const CameraKeyframe &key)
+    {
+        auto position = std::upper_bound(keys.begin(), keys.end(), key.time, [](double time, const CameraKeyframe &k)
+        { return time < k.time; });
+        keys.insert(position, key);
+    }
+
+    bool Empty() const
+    { return keys.empty(); }
+
+    double StartTime() const
+    { return keys.front().time; }
+
+    double EndTime() const
+    { return keys.back().time; }
+
+    // Time of frame index out of frameCount frames spread evenly from the first to the last keyframe.
+    double FrameTime(int index, int frameCount) const
+    {
+        if (frameCount <= 1)
+        {
+            return StartTime();
+        }
+        return StartTime() + (EndTime() - StartTime()) * index / (frameCount - 1);
+    }
+
+    CameraKeyframe At(double time) const
+    {
+        if (time <= StartTime())
+        {
+            return keys.front();
+        }
+        if (time >= EndTime())
+        {
+            return keys.back();
+        }
+
+        // Segment [k1, k2] containing time, with its neighbours for the spline tangents.
+        size_t k2 = size_t(std::upper_bound(keys.begin(), keys.end(), time, [](double t, const CameraKeyframe &k)
+        { return t < k.time; }) - keys.begin());
+        size_t k1 = k2 - 1;
+        size_t k0 = k1 > 0 ? k1 - 1 : k1;
+        size_t k3 = k2 + 1 < keys.size() ? k2 + 1 : k2;
+
+        double t = (time - keys[k1].time) / (keys[k2].time - keys[k1].time);
+
+        CameraKeyframe result;
+        result.time = time;
+        result.lookFrom = CatmullRom(keys[k0].lookFrom, keys[k1].lookFrom, keys[k2].lookFrom, keys[k3].lookFrom, t);
+        result.lookAt = CatmullRom(keys[k0].lookAt, keys[k1].lookAt, keys[k2].lookAt, keys[k3].lookAt, t);
+        result.vFov = keys[k1].vFov + (keys[k2].vFov - keys[k1].vFov) * t;
+        result.focusDist = keys[k1].focusDist + (keys[k2].focusDist - keys[k1].focusDist) * t;
+        return result;
+    }
+
+    void Apply(Camera &cam, double time) const
+    {
+        auto key = At(time);
+        cam.lookFrom = key.lookFrom;
+        cam.lookAt = key.lookAt;
+        cam.vFov = key.vFov;
+        cam.focusDist = key.focusDist;
+    }
+
+private:
+    std::vector<CameraKeyframe> keys;  // Sorted by time
+
+    static Point3 CatmullRom(const Point3 &p0, const Point3 &p1, const Point3 &p2, const Point3 &p3, double t)
+    {
+        auto t2 = Real(t * t);
+        auto t3 = Real(t * t * t);
+        return Real(0.5) * ((2 * p1) + Real(t) * (p2 - p0) + t2 * (2 * p0 - 5 * p1 + 4 * p2 - p3)
+                            + t3 * (3 * p1 - p0 - 3 * p2 + p3));
+    }
+};
+
+inline CameraPath LoadCameraPath(const std::string &path)
+{
+    MappedFile file(path);
+    SceneTokenizer tokens(file.Data(), file.Data() + file.Size(), path);
+
+    CameraPath cameraPath;
+    while (tokens.NextLine())
+    {
+        auto statement = tokens.Word();
+        if (statement != "key")
+        {
+            tokens.Fail("unknown statement '" + std::string(statement) + "'");
+        }
+
+        CameraKeyframe key;
+        key.time = tokens.Number();
+        key.lookFrom = tokens.Vector();
+        key.lookAt = tokens.Vector();
+        key.vFov = tokens.Number();
+        key.focusDist = tokens.Number();
+        tokens.EndLine();
+        cameraPath.Add(key);
+    }
+
+    if (cameraPath.Empty())
+    {
+        throw std::runtime_error(path + " has no keyframes.");
+    }
+    return cameraPath;
+}
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include "Image.hpp"
+#include "ThreadPool.hpp"
+#include "AlignedAllocator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define RT_DENOISER_X86 1
+#include <immintrin.h>
+#endif
+
+// Edge-avoiding À-Trous wavelet filter (Dammertz et al., "Edge-Avoiding À-Trous Wavelet Transform for
+// fast Global Illumination Filtering", 2010), guided by the albedo and normal Camera records at the
+// first hit of every pixel. Each pass blends every pixel with 5x5 neighbours spaced 2^pass pixels
+// apart, weighted by the B3 spline and by how close the neighbour's color, normal and albedo are, so
+// five passes cover a wide area at 25 taps each while edges in the guides stay sharp. The albedo is
+// divided out before filtering and multiplied back afterwards, which keeps surface colors crisp and
+// leaves only the noisy illumination to blur.
+
+struct DenoiseSettings
+{
+    int iterations = 5;         // Filter passes; pass i spaces its taps 2^i pixels apart
+    float sigmaColor = 0.8f;    // Illumination difference at which a neighbour counts 1/e as much, halved every pass
+    float sigmaNormal = 0.5f;   // Normal difference at which a neighbour counts 1/e as much
+    float sigmaAlbedo = 0.3f;   // Albedo difference at which a neighbour counts 1/e as much
+};
+
+// Albedo channels are raised to this before dividing by them, so black surfaces don't blow up.
+constexpr float DenoiseAlbedoFloor = 0.01f;
+
+// B3 spline weights of the five taps along each axis.
+constexpr float ATrousKernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+
+// e^-x for x >= 0 to within 1e-4, from a degree 5 polynomial for the fraction of the power of two.
+// Much cheaper than std::exp, and computed the same way in the scalar and the SIMD path. Results stop
+// at 2^-64, where weights no longer matter, so that products of them never turn into slow denormals.
+inline float NegExp(float x)
+{
+    float y = std::max(x * -1.44269504f, -64.0f);
+    float n = std::floor(y);
+    float f = y - n;
+    float p = ((((0.001333355f * f + 0.009618129f) * f + 0.05550411f) * f + 0.2402265f) * f + 0.6931472f) * f + 1;
+    return p * std::bit_cast<float>(uint32_t(int(n) + 127) << 23);
+}
+
+// One filter pass over planar images: channel c of pixel p is at c * planeSize + p.
+struct ATrousPass
+{
+    const float *in;        // Illumination being filtered
+    float *out;
+    const float *albedo;
+    const float *normal;
+    size_t planeSize;
+    int width, height;
+    int step;               // Pixels between two taps
+    float colorScale;       // 1 / sigma^2 of each guide
+    float normalScale;
+    float albedoScale;
+};
+
+inline void ATrousPixel(const ATrousPass &pass, int x, int y)
+{
+    const size_t n = pass.planeSize;
+    const size_t p = size_t(y) * pass.width + x;
+    float sum[3] = {}, weightSum = 0;
+
+    for (int dy = -2; dy <= 2; dy++)
+    {
+        int yy = y + dy * pass.step;
+        if (yy < 0 || yy >= pass.height)
+        {
+            continue;
+        }
+        for (int dx = -2; dx <= 2; dx++)
+        {
+            int xx = x + dx * pass.step;
+            if (xx < 0 || xx >= pass.width)
+            {
+                continue;
+            }
+
+            size_t q = size_t(yy) * pass.width + xx;
+            float colorDistance = 0, normalDistance = 0, albedoDistance = 0;
+            for (int c = 0; c < 3; c++)
+            {
+                float dc = pass.in[c * n + q] - pass.in[c * n + p];
+                float dn = pass.normal[c * n + q] - pass.normal[c * n + p];
+                float da = pass.albedo[c * n + q] - pass.albedo[c * n + p];
+                colorDistance += dc * dc;
+                normalDistance += dn * dn;
+                albedoDistance += da * da;
+            }
+
+            float weight = ATrousKernel[dx + 2] * ATrousKernel[dy + 2]
+                           * NegExp(colorDistance * pass.colorScale + normalDistance * pass.normalScale
+                                    + albedoDistance * pass.albedoScale);
+            for (int c = 0; c < 3; c++)
+            {
+                sum[c] += weight * pass.in[c * n + q];
+            }
+            weightSum += weight;
+        }
+    }
+
+    // The center tap always counts, so weightSum is never zero.
+    for (int c = 0; c < 3; c++)
+    {
+        pass.out[c * n + p] = sum[c] / weightSum;
+    }
+}
+
+#ifdef RT_DENOISER_X86
+__attribute__((target("avx2")))
+inline __m256 NegExpAvx2(__m256 x)
+{
+    __m256 y = _mm256_max_ps(_mm256_mul_ps(x, _mm256_set1_ps(-1.44269504f)), _mm256_set1_ps(-64.0f));
+    __m256 n = _mm256_floor_ps(y);
+    __m256 f = _mm256_sub_ps(y, n);
+    __m256 p = _mm256_set1_ps(0.001333355f);
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.009618129f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.05550411f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.2402265f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.6931472f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f));
+    __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(exponent));
+}
+
+// Filters pixels [x0, x1) of row y eight at a time. Every tap of these pixels must lie inside the row,
+// so the eight neighbours of a tap are one unaligned load per plane.
+__attribute__((target("avx2")))
+inline int ATrousRowAvx2(const ATrousPass &pass, int y, int x0, int x1)
+{
+    const size_t n = pass.planeSize;
+    const __m256 colorScale = _mm256_set1_ps(pass.colorScale);
+    const __m256 normalScale = _mm256_set1_ps(pass.normalScale);
+    const __m256 albedoScale = _mm256_set1_ps(pass.albedoScale);
+
+    int x = x0;
+    for (; x + 8 <= x1; x += 8)
+    {
+        const size_t p = size_t(y) * pass.width + x;
+        __m256 center[9];
+        for (int c = 0; c < 3; c++)
+        {
+            center[c] = _mm256_loadu_ps(pass.in + c * n + p);
+            center[3 + c] = _mm256_loadu_ps(pass.normal + c * n + p);
+            center[6 + c] = _mm256_loadu_ps(pass.albedo + c * n + p);
+        }
+
+        __m256 sum[3] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        __m256 weightSum = _mm256_setzero_ps();
+
+        for (int dy = -2; dy <= 2; dy++)
+        {
+            int yy = y + dy * pass.step;
+            if (yy < 0 || yy >= pass.height)
+            {
+                continue;
+            }
+            for (int dx = -2; dx <= 2; dx++)
+            {
+                const size_t q = size_t(yy) * pass.width + x + dx * pass.step;
+                __m256 colors[3];
+                __m256 colorDistance = _mm256_setzero_ps();
+                __m256 normalDistance = _mm256_setzero_ps();
+                __m256 albedoDistance = _mm256_setzero_ps();
+                for (int c = 0; c < 3; c++)
+                {
+                    colors[c] = _mm256_loadu_ps(pass.in + c * n + q);
+                    __m256 dc = _mm256_sub_ps(colors[c], center[c]);
+                    __m256 dn = _mm256_sub_ps(_mm256_loadu_ps(pass.normal + c * n + q), center[3 + c]);
+                    __m256 da = _mm256_sub_ps(_mm256_loadu_ps(pass.albedo + c * n + q), center[6 + c]);
+                    colorDistance = _mm256_add_ps(colorDistance, _mm256_mul_ps(dc, dc));
+                    normalDistance = _mm256_add_ps(normalDistance, _mm256_mul_ps(dn, dn));
+                    albedoDistance = _mm256_add_ps(albedoDistance, _mm256_mul_ps(da, da));
+                }
+
+                __m256 exponent = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(colorDistance, colorScale),
+                                                              _mm256_mul_ps(normalDistance, normalScale)),
+                                                _mm256_mul_ps(albedoDistance, albedoScale));
+                __m256 weight = _mm256_mul_ps(_mm256_set1_ps(ATrousKernel[dx + 2] * ATrousKernel[dy + 2]),
+                                              NegExpAvx2(exponent));
+                for (int c = 0; c < 3; c++)
+                {
+                    sum[c] = _mm256_add_ps(sum[c], _mm256_mul_ps(weight, colors[c]));
+                }
+                weightSum = _mm256_add_ps(weightSum, weight);
+            }
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            _mm256_storeu_ps(pass.out + c * n + p, _mm256_div_ps(sum[c], weightSum));
+        }
+    }
+    return x;
+}
+#endif
+
+// Filters row y. Pixels whose taps all lie inside the row take the SIMD path where the CPU has AVX2;
+// the ones near the left and right edges, which skip the taps outside, take the scalar path.
+inline void ATrousRow(const ATrousPass &pass, int y)
+{
+    int x = 0;
+#ifdef RT_DENOISER_X86
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    const int margin = 2 * pass.step;
+    if (hasAvx2 && pass.width - 2 * margin >= 8)
+    {
+        for (; x < margin; x++)
+        {
+            ATrousPixel(pass, x, y);
+        }
+        x = ATrousRowAvx2(pass, y, margin, pass.width - margin);
+    }
+#endif
+    for (; x < pass.width; x++)
+    {
+        ATrousPixel(pass, x, y);
+    }
+}
+
+// Runs row(y) for every row on the threads of pool, which pull bands of rows from a shared counter.
+template<typename RowFunction>
+void ParallelRows(ThreadPool &pool, int height, RowFunction &&row)
+{
+    constexpr int BandRows = 4;
+    std::atomic<int> nextBand = 0;
+    pool.Start([&](int)
+               {
+                   for (int y0 = BandRows * nextBand++; y0 < height; y0 = BandRows * nextBand++)
+                   {
+                       for (int y = y0; y < std::min(height, y0 + BandRows); y++)
+                       {
+                           row(y);
+                       }
+                   }
+               });
+    pool.Wait();
+}
+
+// Denoises color in place, guided by the average first-hit albedo and normal of the same pixels.
+// Non-finite color values are dropped to black rather than smeared over their neighbours.
+inline void Denoise(Image &color, const Image &albedo, const Image &normal, const DenoiseSettings &settings,
+                    ThreadPool &pool)
+{
+    const int width = color.Width();
+    const int height = color.Height();
+    const size_t n = size_t(width) * height;
+    AlignedVector<float> illumination(3 * n), filtered(3 * n), albedoPlanes(3 * n), normalPlanes(3 * n);
+
+    ParallelRows(pool, height, [&](int y)
+    {
+        for (size_t p = size_t(y) * width; p < size_t(y + 1) * width; p++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                float value = color.Data()[3 * p + c];
+                float a = albedo.Data()[3 * p + c];
+                illumination[c * n + p] = std::isfinite(value) ? value / std::max(a, DenoiseAlbedoFloor) : 0.0f;
+                albedoPlanes[c * n + p] = a;
+                normalPlanes[c * n + p] = normal.Data()[3 * p + c];
+            }
+        }
+    });
+
+    float sigmaColor = settings.sigmaColor;
+    for (int i = 0; i < settings.iterations; i++)
+    {
+        ATrousPass pass{illumination.data(), filtered.data(), albedoPlanes.data(), normalPlanes.data(), n,
+                        width, height, 1 << i, 1 / (sigmaColor * sigmaColor),
+                        1 / (settings.sigmaNormal * settings.sigmaNormal),
+                        1 / (settings.sigmaAlbedo * settings.sigmaAlbedo)};
+        ParallelRows(pool, height, [&](int y)
+        { ATrousRow(pass, y); });
+        illumination.swap(filtered);
+        sigmaColor /= 2;
+    }
+
+    ParallelRows(pool, height, [&](int y)
+    {
+        for (size_t p = size_t(y) * width; p < size_t(y + 1) * width; p++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                color.Data()[3 * p + c] = illumination[c * n + p] * std::max(albedoPlanes[c * n + p],
+                                                                             DenoiseAlbedoFloor);
+            }
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,534 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "Camera.hpp"
+#include "Image.hpp"
+#include "RenderStats.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__APPLE__) || defined(__linux__)
+#define RT_HAVE_PROCESSES 1
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Distributed rendering: a coordinator splits the image into regions and hands them to worker
+// processes, each of which has loaded the same scene, and puts the returned float pixels together.
+// Workers talk over their stdin and stdout, so a worker can be a local process or any command that
+// forwards those, such as "ssh host inOneWeekend". Every pixel depends only on the scene, the camera
+// settings and the seed, so the image is the same as a single process render no matter which worker
+// renders which region.
+//
+// The protocol is binary, in the byte order of the machines involved:
+//     worker -> coordinator: WorkerHello once the scene is loaded
+//     coordinator -> worker: RegionMessage, a region to render; closing stdin ends the worker
+//     worker -> coordinator: RegionMessage, RenderStats, then three floats per pixel row by row
+
+constexpr uint32_t WorkerProtocolMagic = 0x32575452;  // "RTW2"
+
+// Everything about the scene, the camera and the build that changes pixels. The coordinator only
+// uses workers whose hello equals its own, so their regions fit together into the same image.
+struct WorkerHello
+{
+    uint32_t magic;
+    uint32_t realSize;          // sizeof(Real); float and double builds trace slightly different paths
+    int32_t imageWidth, imageHeight;
+    int32_t samplesPerPixel, maxDepth;
+    int32_t sampler, integrator;
+    int32_t russianRoulette, rouletteMinDepth;
+    int32_t adaptiveSampling, minSamplesPerPixel;
+    uint64_t seed;
+    uint64_t sceneFingerprint;  // Scene::Fingerprint()
+    double aspectRatio, vFov;
+    double lookFrom[3], lookAt[3], vUp[3];
+    double defocusAngle, focusDist;
+    double shutterOpen, shutterClose;
+    double noiseThreshold;
+
+    bool operator==(const WorkerHello &) const = default;
+};
+
+inline WorkerHello MakeWorkerHello(const Camera &cam, uint64_t sceneFingerprint)
+{
+    WorkerHello hello{};
+    hello.magic = WorkerProtocolMagic;
+    hello.realSize = sizeof(Real);
+    hello.imageWidth = cam.imageWidth;
+    hello.imageHeight = cam.ImageHeight();
+    hello.samplesPerPixel = cam.samplesPerPixel;
+    hello.maxDepth = cam.maxDepth;
+    hello.sampler = int32_t(cam.sampler);
+    hello.integrator = int32_t(cam.integrator);
+    hello.russianRoulette = cam.russianRoulette;
+    hello.rouletteMinDepth = cam.rouletteMinDepth;
+    hello.adaptiveSampling = cam.adaptiveSampling;
+    hello.minSamplesPerPixel = cam.minSamplesPerPixel;
+    hello.seed = cam.seed;
+    hello.sceneFingerprint = sceneFingerprint;
+    hello.aspectRatio = cam.aspectRatio;
+    hello.vFov = cam.vFov;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        hello.lookFrom[axis] = cam.lookFrom[axis];
+        hello.lookAt[axis] = cam.lookAt[axis];
+        hello.vUp[axis] = cam.vUp[axis];
+    }
+    hello.defocusAngle = cam.defocusAngle;
+    hello.focusDist = cam.focusDist;
+    hello.shutterOpen = cam.shutterOpen;
+    hello.shutterClose = cam.shutterClose;
+    hello.noiseThreshold = cam.noiseThreshold;
+    return hello;
+}
+
+struct RegionMessage
+{
+    int32_t x0, y0, x1, y1;
+
+    size_t PixelCount() const
+    { return size_t(x1 - x0) * size_t(y1 - y0); }
+
+    // Whether the region is non-empty and lies inside an image of width by height pixels.
+    bool Inside(int width, int height) const
+    { return 0 <= x0 && x0 < x1 && x1 <= width && 0 <= y0 && y0 < y1 && y1 <= height; }
+
+    bool operator==(const RegionMessage &) const = default;
+};
+
+static_assert(std::is_trivially_copyable_v<RenderStats>, "RenderStats is sent as raw bytes");
+
+#ifdef RT_HAVE_PROCESSES
+
+// Reads exactly size bytes. Returns false if the other end closed the pipe first.
+inline bool ReadExact(int fd, void *data, size_t size)
+{
+    auto bytes = static_cast<char *>(data);
+    while (size > 0)
+    {
+        ssize_t count = read(fd, bytes, size);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        bytes += count;
+        size -= size_t(count);
+    }
+    return true;
+}
+
+inline bool WriteExact(int fd, const void *data, size_t size)
+{
+    auto bytes = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        ssize_t count = write(fd, bytes, size);
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count <= 0)
+        {
+            return false;
+        }
+        bytes += count;
+        size -= size_t(count);
+    }
+    return true;
+}
+
+// Moves stdout out of the way for the protocol: returns a descriptor of the original stdout and
+// points stdout at stderr, so nothing else the process prints can corrupt the stream.
+inline int TakeStdoutForProtocol()
+{
+    int protocolFd = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    return protocolFd;
+}
+
+// Worker side: renders the regions asked for on inFd until it is closed, answering on outFd.
+// sceneFingerprint identifies the loaded scene to the coordinator, see Scene::Fingerprint().
+inline void RunRenderWorker(Camera &cam, const HitTable &world, const MaterialTable &materials,
+                            uint64_t sceneFingerprint, int inFd, int outFd)
+{
+    cam.verbose = false;
+
+    WorkerHello hello = MakeWorkerHello(cam, sceneFingerprint);
+    if (!WriteExact(outFd, &hello, sizeof(hello)))
+    {
+        return;
+    }
+
+    RegionMessage region{};
+    std::vector<float> pixels;
+    while (ReadExact(inFd, &region, sizeof(region)))
+    {
+        if (!region.Inside(cam.imageWidth, cam.ImageHeight()))
+        {
+            throw std::runtime_error("Asked to render a region outside the image.");
+        }
+
+        cam.RenderRegion(world, materials, {region.x0, region.y0, region.x1, region.y1});
+
+        pixels.resize(region.PixelCount() * 3);
+        const size_t rowFloats = size_t(region.x1 - region.x0) * 3;
+        for (int j = region.y0; j < region.y1; j++)
+        {
+            const float *row = cam.frameBuffer.Data() + (size_t(j) * cam.imageWidth + region.x0) * 3;
+            std::copy(row, row + rowFloats, pixels.data() + size_t(j - region.y0) * rowFloats);
+        }
+
+        if (!WriteExact(outFd, &region, sizeof(region))
+            || !WriteExact(outFd, &cam.renderStats, sizeof(RenderStats))
+            || !WriteExact(outFd, pixels.data(), pixels.size() * sizeof(float)))
+        {
+            return;
+        }
+    }
+}
+
+// A worker started with "/bin/sh -c command", its stdin and stdout connected to pipes.
+class WorkerProcess
+{
+public:
+    explicit WorkerProcess(const std::string &command) : command(command)
+    {
+        int toWorker[2], fromWorker[2];
+        if (pipe(toWorker) != 0)
+        {
+            throw std::runtime_error("Failed to create a pipe for worker '" + command + "'.");
+        }
+        if (pipe(fromWorker) != 0)
+        {
+            close(toWorker[0]);
+            close(toWorker[1]);
+            throw std::runtime_error("Failed to create a pipe for worker '" + command + "'.");
+        }
+
+        // Not inherited by later workers, or they would keep each other's stdin open.
+        for (int fd: {toWorker[0], toWorker[1], fromWorker[0], fromWorker[1]})
+        {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+
+        pid = fork();
+        if (pid < 0)
+        {
+            for (int fd: {toWorker[0], toWorker[1], fromWorker[0], fromWorker[1]})
+            {
+                close(fd);
+            }
+            throw std::runtime_error("Failed to start worker '" + command + "'.");
+        }
+        if (pid == 0)
+        {
+            // A process group of its own, so Terminate() also reaches what the shell started.
+            setpgid(0, 0);
+            dup2(toWorker[0], STDIN_FILENO);
+            dup2(fromWorker[1], STDOUT_FILENO);
+            execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char *>(nullptr));
+            _exit(127);
+        }
+
+        setpgid(pid, pid);  // Also here, in case the child hasn't run yet
+        close(toWorker[0]);
+        close(fromWorker[1]);
+        input = toWorker[1];
+        output = fromWorker[0];
+    }
+
+    WorkerProcess(const WorkerProcess &) = delete;
+
+    WorkerProcess &operator=(const WorkerProcess &) = delete;
+
+    ~WorkerProcess()
+    {
+        CloseInput();
+        if (output >= 0)
+        {
+            close(output);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+    }
+
+    int Input() const
+    { return input; }
+
+    int Output() const
+    { return output; }
+
+    const std::string &Command() const
+    { return command; }
+
+    // Ends a worker that may not be reading its input, with every process the command started.
+    void Terminate()
+    {
+        kill(-pid, SIGTERM);
+    }
+
+    // Tells the worker that no more regions follow, which makes it exit.
+    void CloseInput()
+    {
+        if (input >= 0)
+        {
+            close(input);
+            input = -1;
+        }
+    }
+
+private:
+    std::string command;
+    pid_t pid = -1;
+    int input = -1;
+    int output = -1;
+};
+
+// Coordinator side: renders the image of cam on one worker per command, handing out regions of
+// regionSize pixels as workers become free, and returns it with the workers' merged stats. The
+// region of a worker that dies, or that takes longer than timeout seconds to load the scene or to
+// render a region, is given to another one; the render fails only once all workers are gone. A
+// timeout of 0 waits forever. Workers must have loaded the scene with fingerprint sceneFingerprint.
+inline Image RenderDistributed(const Camera &cam, uint64_t sceneFingerprint, const std::vector<std::string> &commands,
+                               int regionSize, double timeout, RenderStats &stats)
+{
+    // A dead worker must show up as a failed write, not end the coordinator.
+    signal(SIGPIPE, SIG_IGN);
+
+    const int width = cam.imageWidth;
+    const int height = cam.ImageHeight();
+    const int size = std::max(1, regionSize);
+
+    std::deque<RegionMessage> pending;
+    for (int y0 = 0; y0 < height; y0 += size)
+    {
+        for (int x0 = 0; x0 < width; x0 += size)
+        {
+            pending.push_back({x0, y0, std::min(x0 + size, width), std::min(y0 + size, height)});
+        }
+    }
+    const size_t regionCount = pending.size();
+
+    std::vector<std::unique_ptr<WorkerProcess>> workers;
+    for (const auto &command: commands)
+    {
+        workers.push_back(std::make_unique<WorkerProcess>(command));
+    }
+
+    const WorkerHello expectedHello = MakeWorkerHello(cam, sceneFingerprint);
+
+    Image image(width, height);
+    stats = RenderStats();
+    std::vector<bool> started(workers.size(), false);   // Whether the worker's hello has arrived
+    std::vector<std::optional<RegionMessage>> assigned(workers.size());
+    using Clock = std::chrono::steady_clock;
+    const auto timeLimit = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(timeout));
+    std::vector<Clock::time_point> deadlines(workers.size(), Clock::now() + timeLimit);   // For the next answer
+    std::vector<float> pixels;
+    size_t completed = 0;
+
+    // Gives up on worker w, putting the region it was rendering back. The worker is ended first, since
+    // one that still runs would keep its destructor waiting.
+    auto drop = [&](size_t w, const char *reason)
+    {
+        std::cerr << "Worker '" << workers[w]->Command() << "' " << reason << ".\n";
+        if (assigned[w])
+        {
+            pending.push_front(*assigned[w]);
+            assigned[w].reset();
+        }
+        workers[w]->Terminate();
+        workers[w].reset();
+    };
+
+    // Gives region to worker w, or puts it back if the worker is gone.
+    auto assign = [&](size_t w, const RegionMessage &region)
+    {
+        assigned[w] = region;
+        deadlines[w] = Clock::now() + timeLimit;
+        if (!WriteExact(workers[w]->Input(), &region, sizeof(region)))
+        {
+            drop(w, "stopped");
+        }
+    };
+
+    while (completed < regionCount)
+    {
+        for (size_t w = 0; w < workers.size() && !pending.empty(); w++)
+        {
+            if (workers[w] && started[w] && !assigned[w])
+            {
+                auto region = pending.front();
+                pending.pop_front();
+                assign(w, region);
+            }
+        }
+
+        // Workers are polled for their hello and then for the regions they were given, so the ones
+        // that are ready render while the others are still loading the scene.
+        std::vector<pollfd> polls;
+        std::vector<size_t> polled;
+        for (size_t w = 0; w < workers.size(); w++)
+        {
+            if (workers[w] && (!started[w] || assigned[w]))
+            {
+                polls.push_back({workers[w]->Output(), POLLIN, 0});
+                polled.push_back(w);
+            }
+        }
+        if (polls.empty())
+        {
+            throw std::runtime_error("All render workers have stopped.");
+        }
+
+        // Waits until the earliest deadline of the polled workers at most.
+        int waitMs = -1;
+        if (timeout > 0)
+        {
+            auto earliest = deadlines[polled[0]];
+            for (size_t w: polled)
+            {
+                earliest = std::min(earliest, deadlines[w]);
+            }
+            auto remaining = std::chrono::ceil<std::chrono::milliseconds>(earliest - Clock::now()).count();
+            waitMs = int(std::clamp<decltype(remaining)>(remaining, 0, INT_MAX));
+        }
+
+        if (poll(polls.data(), polls.size(), waitMs) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw std::runtime_error("Failed to wait for the render workers.");
+        }
+
+        const auto now = Clock::now();
+        for (size_t k = 0; k < polls.size(); k++)
+        {
+            size_t w = polled[k];
+            if (polls[k].revents == 0)
+            {
+                if (timeout > 0 && now >= deadlines[w])
+                {
+                    drop(w, started[w] ? "timed out rendering a region" : "timed out loading the scene");
+                }
+                continue;
+            }
+
+            if (!started[w])
+            {
+                WorkerHello hello{};
+                if (!ReadExact(workers[w]->Output(), &hello, sizeof(hello)) || hello.magic != WorkerProtocolMagic)
+                {
+                    drop(w, "failed to start");
+                    continue;
+                }
+                if (hello.sceneFingerprint != expectedHello.sceneFingerprint)
+                {
+                    throw std::runtime_error("Worker '" + workers[w]->Command() + "' loaded a different scene.");
+                }
+                if (hello != expectedHello)
+                {
+                    throw std::runtime_error("Worker '" + workers[w]->Command() + "' renders a different image.");
+                }
+                started[w] = true;
+                continue;
+            }
+
+            RegionMessage region{};
+            RenderStats regionStats;
+            if (!ReadExact(workers[w]->Output(), &region, sizeof(region))
+                || !ReadExact(workers[w]->Output(), &regionStats, sizeof(regionStats)))
+            {
+                drop(w, "stopped");
+                continue;
+            }
+
+            // Only the region the worker was given is written, at the size it was given with; a
+            // worker answering anything else is out of step with the protocol.
+            if (region != *assigned[w] || !region.Inside(width, height))
+            {
+                drop(w, "returned a region it wasn't given");
+                continue;
+            }
+            pixels.resize(region.PixelCount() * 3);
+            if (!ReadExact(workers[w]->Output(), pixels.data(), pixels.size() * sizeof(float)))
+            {
+                drop(w, "stopped");
+                continue;
+            }
+
+            const size_t rowFloats = size_t(region.x1 - region.x0) * 3;
+            for (int j = region.y0; j < region.y1; j++)
+            {
+                std::copy_n(pixels.data() + size_t(j - region.y0) * rowFloats, rowFloats,
+                            image.Data() + (size_t(j) * width + region.x0) * 3);
+            }
+            stats.Merge(regionStats);
+            assigned[w].reset();
+            completed++;
+
+            if (cam.verbose)
+            {
+                std::clog << "\rRendering: " << completed * 100 / regionCount << "%" << std::flush;
+            }
+        }
+    }
+
+    // Workers still loading the scene when the image was finished aren't needed any more.
+    for (size_t w = 0; w < workers.size(); w++)
+    {
+        if (workers[w] && !started[w])
+        {
+            workers[w]->Terminate();
+        }
+    }
+
+    if (cam.verbose)
+    {
+        std::clog << "\rDone.                 \n";
+    }
+    return image;
+}
+
+#else
+
+inline int TakeStdoutForProtocol()
+{
+    throw std::runtime_error("Render workers are not supported on this platform.");
+}
+
+inline void RunRenderWorker(Camera &, const HitTable &, const MaterialTable &, uint64_t, int, int)
+{
+    throw std::runtime_error("Render workers are not supported on this platform.");
+}
+
+inline Image RenderDistributed(const Camera &, uint64_t, const std::vector<std::string> &, int, double,
+                               RenderStats &)
+{
+    throw std::runtime_error("Distributed rendering is not supported on this platform.");
+}
+
+#endif
+
+#endif
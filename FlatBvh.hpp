@@ -0,0 +1,183 @@
+#ifndef FLAT_BVH_H
+#define FLAT_BVH_H
+
+#include "RTweekend.hpp"
+#include "Aabb.hpp"
+#include "BvhNode.hpp"
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// Node of a FlatBvh. Interior nodes store their first child right after themselves and the index of
+// the second child in offset. Leaves store a range of count primitives starting at offset.
+struct FlatBvhNode
+{
+    Aabb bbox;
+    uint32_t offset = 0;
+    uint16_t count = 0;     // Zero for interior nodes
+    uint8_t axis = 0;       // Split axis, used to visit the nearer child first
+};
+
+// Bounding volume hierarchy stored as one array of nodes over primitives identified by index. It is
+// used inside containers that keep their primitives in flat arrays (for example SphereSet), where a
+// BvhNode per object would cost a heap allocation and a virtual call each.
+class FlatBvh
+{
+public:
+    // Builds the hierarchy over count primitives, where boxOf(i) is the bounding box of primitive i.
+    // Returns the primitive order the leaves refer to: leaf ranges index into this order, so
+    // containers reorder their arrays accordingly. boxOf is called once per primitive; the boxes are
+    // gathered into scratch and partitioned along with the primitives, so every pass of the builder
+    // reads them in sequence.
+    template<typename BoxFunction>
+    std::vector<uint32_t> Build(size_t count, BoxFunction boxOf, int maxLeafSize, Arena &scratch)
+    {
+        auto *primitives = scratch.Allocate<BuildPrimitive>(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            primitives[i] = {boxOf(uint32_t(i)), uint32_t(i)};
+        }
+
+        nodes.clear();
+        if (count > 0)
+        {
+            nodes.reserve(2 * count / std::max(1, maxLeafSize) + 1);
+            BuildRange(primitives, 0, count, std::clamp(maxLeafSize, 1, 65535), 0);
+            nodes.shrink_to_fit();
+        }
+
+        std::vector<uint32_t> order(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            order[i] = primitives[i].index;
+        }
+        return order;
+    }
+
+    bool Empty() const
+    { return nodes.empty(); }
+
+    Aabb Bounds() const
+    { return nodes.empty() ? Aabb::empty : nodes[0].bbox; }
+
+    size_t MemoryBytes() const
+    { return nodes.capacity() * sizeof(FlatBvhNode); }
+
+    // Visits every leaf whose box the Ray enters within rayT, nearest child first. hitLeaf(first,
+    // count, rayT) tests the primitives of one leaf and returns true on a hit, after shrinking
+    // rayT.max to the hit distance so farther nodes are culled.
+    template<typename LeafFunction>
+    bool Traverse(const Ray &r, Interval rayT, LeafFunction &&hitLeaf) const
+    {
+        if (nodes.empty())
+        {
+            return false;
+        }
+
+        const Point3 &origin = r.origin();
+        const Vec3 &dir = r.direction();
+        Vec3 invDir(1 / dir.X(), 1 / dir.Y(), 1 / dir.Z());
+        bool dirNegative[3] = {dir.X() < 0, dir.Y() < 0, dir.Z() < 0};
+
+        uint32_t stack[MaxDepth];
+        int stackSize = 0;
+        uint32_t current = 0;
+        bool hitAnything = false;
+
+        while (true)
+        {
+            const FlatBvhNode &node = nodes[current];
+            if (node.bbox.Hit(origin, invDir, rayT))
+            {
+                if (node.count > 0)
+                {
+                    hitAnything |= hitLeaf(node.offset, uint32_t(node.count), rayT);
+                }
+                else if (dirNegative[node.axis])
+                {
+                    stack[stackSize++] = current + 1;
+                    current = node.offset;
+                    continue;
+                }
+                else
+                {
+                    stack[stackSize++] = node.offset;
+                    current = current + 1;
+                    continue;
+                }
+            }
+
+            if (stackSize == 0)
+            {
+                break;
+            }
+            current = stack[--stackSize];
+        }
+
+        return hitAnything;
+    }
+
+private:
+    // Below MedianSplitDepth the builder stops using the SAH and splits at the median, which bounds
+    // the depth, and with it the traversal stack, even for degenerate inputs.
+    static constexpr int MedianSplitDepth = 48;
+    static constexpr int MaxDepth = 128;
+
+    std::vector<FlatBvhNode> nodes;
+
+    // A primitive while the hierarchy is built: its box and its index in the caller's arrays.
+    struct BuildPrimitive
+    {
+        Aabb box;
+        uint32_t index;
+    };
+
+    uint32_t BuildRange(BuildPrimitive *primitives, size_t start, size_t end, int maxLeafSize, int depth)
+    {
+        auto index = uint32_t(nodes.size());
+        nodes.emplace_back();
+
+        Aabb bbox;
+        for (size_t i = start; i < end; i++)
+        {
+            bbox = Aabb(bbox, primitives[i].box);
+        }
+        nodes[index].bbox = bbox;
+
+        if (end - start <= size_t(maxLeafSize))
+        {
+            nodes[index].offset = uint32_t(start);
+            nodes[index].count = uint16_t(end - start);
+            return index;
+        }
+
+        auto first = primitives + start;
+        auto last = primitives + end;
+        // The children are ordered along the axis they were split on, for front-to-back traversal.
+        int axis = bbox.LongestAxis();
+
+        BuildPrimitive *split;
+        if (depth < MedianSplitDepth)
+        {
+            split = SahPartition(first, last, [](const BuildPrimitive &primitive) -> const Aabb &
+            { return primitive.box; }, &axis);
+        }
+        else
+        {
+            split = first + (last - first) / 2;
+            std::nth_element(first, split, last, [axis](const BuildPrimitive &a, const BuildPrimitive &b)
+            { return a.box.Centroid()[axis] < b.box.Centroid()[axis]; });
+        }
+
+        auto mid = start + (split - first);
+        BuildRange(primitives, start, mid, maxLeafSize, depth + 1);
+        auto right = BuildRange(primitives, mid, end, maxLeafSize, depth + 1);
+
+        nodes[index].offset = right;
+        nodes[index].axis = uint8_t(axis);
+        return index;
+    }
+};
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include "Image.hpp"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+// Encodes and writes finished frames on a thread of its own, so that saving frame k overlaps with
+// rendering frame k + 1. At most maxQueued frames wait to be written; Submit() blocks beyond that,
+// which keeps memory bounded when encoding is slower than rendering.
+class FrameWriter
+{
+public:
+    using WriteFunction = std::function<void(const Image &, const std::string &)>;
+
+    explicit FrameWriter(WriteFunction write, size_t maxQueued = 2) : write(std::move(write)), maxQueued(maxQueued)
+    {
+        thread = std::thread([this]()
+                             { WriterLoop(); });
+    }
+
+    FrameWriter(const FrameWriter &) = delete;
+
+    FrameWriter &operator=(const FrameWriter &) = delete;
+
+    ~FrameWriter()
+    {
+        Close();
+    }
+
+    void Submit(Image image, const std::string &fileName)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        spaceAvailable.wait(lock, [this]()
+        { return queue.size() < maxQueued || error; });
+        RethrowError();
+
+        queue.emplace_back(std::move(image), fileName);
+        frameAvailable.notify_one();
+    }
+
+    // Writes the remaining frames and stops the writer thread. Rethrows the first error of a write.
+    void Finish()
+    {
+        Close();
+        std::lock_guard<std::mutex> lock(mutex);
+        RethrowError();
+    }
+
+private:
+    WriteFunction write;
+    size_t maxQueued;
+    std::deque<std::pair<Image, std::string>> queue;
+    std::mutex mutex;
+    std::condition_variable frameAvailable;
+    std::condition_variable spaceAvailable;
+    std::exception_ptr error;
+    bool closing = false;
+    std::thread thread;
+
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+        }
+        frameAvailable.notify_one();
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+    void RethrowError()
+    {
+        if (error)
+        {
+            std::rethrow_exception(std::exchange(error, nullptr));
+        }
+    }
+
+    void WriterLoop()
+    {
+        while (true)
+        {
+            std::pair<Image, std::string> frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                frameAvailable.wait(lock, [this]()
+                { return !queue.empty() || closing; });
+                if (queue.empty())
+                {
+                    return;
+                }
+                frame = std::move(queue.front());
+                queue.pop_front();
+            }
+            spaceAvailable.notify_one();
+
+            try
+            {
+                write(frame.first, frame.second);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+                spaceAvailable.notify_one();
+            }
+        }
+    }
+};
+
+#endif
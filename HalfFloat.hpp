@@ -0,0 +1,97 @@
+#ifndef HALF_FLOAT_H
+#define HALF_FLOAT_H
+
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define RT_HALF_FLOAT_X86 1
+#include <immintrin.h>
+#endif
+
+// IEEE 754 half precision (binary16), the pixel type of most OpenEXR files: 1 sign bit, 5 exponent
+// bits and 10 mantissa bits, exact to about three decimal digits up to 65504.
+
+// Rounds to the nearest half, ties to even. Values beyond the half range become infinity; NaN stays
+// NaN.
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t bits = std::bit_cast<uint32_t>(value);
+    auto sign = uint16_t((bits >> 16) & 0x8000);
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude >= 0x7f800000)
+    {
+        return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+    }
+    if (magnitude >= 0x477ff000)    // 65520 and up round past the largest half
+    {
+        return sign | 0x7c00;
+    }
+    if (magnitude < 0x38800000)     // Below 2^-14, a subnormal half in units of 2^-24
+    {
+        return sign | uint16_t(std::nearbyint(std::bit_cast<float>(magnitude) * 0x1p24f));
+    }
+
+    // Rebias the exponent from 127 to 15, then drop 13 mantissa bits rounding to even. A carry out of
+    // the mantissa correctly bumps the exponent.
+    uint32_t h = magnitude - 0x38000000;
+    h = (h + 0xfff + ((h >> 13) & 1)) >> 13;
+    return sign | uint16_t(h);
+}
+
+inline float HalfToFloat(uint16_t half)
+{
+    uint32_t sign = uint32_t(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+
+    if (exponent == 0)
+    {
+        float subnormal = float(mantissa) * 0x1p-24f;
+        return sign ? -subnormal : subnormal;
+    }
+    if (exponent == 31)
+    {
+        return std::bit_cast<float>(sign | 0x7f800000 | mantissa << 13);
+    }
+    return std::bit_cast<float>(sign | (exponent + 112) << 23 | mantissa << 13);
+}
+
+#ifdef RT_HALF_FLOAT_X86
+__attribute__((target("avx,f16c")))
+inline void FloatsToHalvesF16c(const float *values, uint16_t *halves, size_t count)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i packed = _mm256_cvtps_ph(_mm256_loadu_ps(values + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(halves + i), packed);
+    }
+    for (; i < count; i++)
+    {
+        halves[i] = FloatToHalf(values[i]);
+    }
+}
+#endif
+
+// Converts count floats to halves, eight per instruction on CPUs with F16C.
+inline void FloatsToHalves(const float *values, uint16_t *halves, size_t count)
+{
+#ifdef RT_HALF_FLOAT_X86
+    static const bool hasF16c = __builtin_cpu_supports("f16c");
+    if (hasF16c)
+    {
+        FloatsToHalvesF16c(values, halves, count);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; i++)
+    {
+        halves[i] = FloatToHalf(values[i]);
+    }
+}
+
+#endif
@@ -2,32 +2,58 @@
 #define HITTABLE_H
 
 #include "Ray.hpp"
+#include "Aabb.hpp"
 
-class Material;
+// Index of a material in the scene's MaterialTable.
+using MaterialId = uint32_t;
 
-class HitRecord
+// Bound on the rounding error of a hit position computed from values up to magnitude. Intersection
+// routines store it in HitRecord::pError.
+template<typename T>
+inline T HitPositionError(T magnitude)
+{
+    return 32 * std::numeric_limits<T>::epsilon() * magnitude;
+}
+
+template<typename T>
+class HitRecordT
 {
 public:
-    Point3 p;
-    Vec3 normal;
-    shared_ptr<Material> mat;
-    double t;
+    Vec3T<T> p;
+    Vec3T<T> normal;
+    MaterialId mat;
+    T t;
+    T pError;       // Bound on the absolute rounding error in each coordinate of p
     bool frontFace;
 
-    void SetFaceNormal(const Ray &r, const Vec3 &outwardNormal)
+    void SetFaceNormal(const RayT<T> &r, const Vec3T<T> &outwardNormal)
     {
         // Sets the Hit record normal vector.
         frontFace = Dot(r.direction(), outwardNormal) < 0;
         normal = frontFace ? outwardNormal : -outwardNormal;
     }
+
+    // Ray leaving the hit point in direction. The origin is pushed off the surface by the position
+    // error, to the side the direction points to, so the new Ray can't hit the same surface again at
+    // t close to zero and scattered rays need no fixed minimum distance. The new Ray keeps the time
+    // of the Ray that hit, so a path sees moving objects at a single moment.
+    RayT<T> SpawnRay(const Vec3T<T> &direction, T time) const
+    {
+        auto offset = pError * normal;
+        return RayT<T>(Dot(direction, normal) > 0 ? p + offset : p - offset, direction, time);
+    }
 };
 
+using HitRecord = HitRecordT<Real>;
+
 class HitTable
 {
 public:
-    ~HitTable() = default;
+    virtual ~HitTable() = default;
 
     virtual bool Hit(const Ray& r, Interval rayT, HitRecord& rec) const = 0;
+
+    virtual Aabb BoundingBox() const = 0;
 };
 
 #endif
\ No newline at end of file
@@ -18,11 +18,15 @@ public:
     { Add(object); }
 
     void Clear()
-    { objects.clear(); }
+    {
+        objects.clear();
+        bbox = Aabb::empty;
+    }
 
     void Add(shared_ptr<HitTable> object)
     {
         objects.push_back(object);
+        bbox = Aabb(bbox, object->BoundingBox());
     }
 
     bool Hit(const Ray& r, Interval rayT, HitRecord& rec) const override
@@ -43,6 +47,12 @@ public:
 
         return hitAnything;
     }
+
+    Aabb BoundingBox() const override
+    { return bbox; }
+
+private:
+    Aabb bbox;
 };
 
 #endif
\ No newline at end of file
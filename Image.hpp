@@ -0,0 +1,67 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "RTweekend.hpp"
+#include "ToneMap.hpp"
+
+#include <vector>
+
+// Contiguous linear RGB frame buffer with three floats per pixel, stored row by row from the top.
+class Image
+{
+public:
+    Image()
+    {}
+
+    Image(int width, int height) : width(width), height(height), pixels(size_t(width) * height * 3, 0.0f)
+    {}
+
+    int Width() const
+    { return width; }
+
+    int Height() const
+    { return height; }
+
+    void SetPixel(int i, int j, const Color &pixelColor)
+    {
+        float *p = &pixels[(size_t(j) * width + i) * 3];
+        p[0] = float(pixelColor.X());
+        p[1] = float(pixelColor.Y());
+        p[2] = float(pixelColor.Z());
+    }
+
+    void AddPixel(int i, int j, const Color &pixelColor)
+    {
+        float *p = &pixels[(size_t(j) * width + i) * 3];
+        p[0] += float(pixelColor.X());
+        p[1] += float(pixelColor.Y());
+        p[2] += float(pixelColor.Z());
+    }
+
+    Color GetPixel(int i, int j) const
+    {
+        const float *p = &pixels[(size_t(j) * width + i) * 3];
+        return Color(p[0], p[1], p[2]);
+    }
+
+    const float *Data() const
+    { return pixels.data(); }
+
+    float *Data()
+    { return pixels.data(); }
+
+    // Converts the whole image to 8-bit RGB for display, three bytes per pixel.
+    std::vector<uint8_t> ToBytes(const ToneMapSettings &toneMap = {}) const
+    {
+        std::vector<uint8_t> bytes(pixels.size());
+        ToneMap(pixels.data(), bytes.data(), pixels.size(), toneMap);
+        return bytes;
+    }
+
+private:
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixels;
+};
+
+#endif
@@ -0,0 +1,338 @@
+#ifndef IMAGE_READER_H
+#define IMAGE_READER_H
+
+#include "Image.hpp"
+#include "HalfFloat.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Loads the linear float images the renderer writes, PFM and uncompressed OpenEXR, so they can be
+// tone mapped again without rendering.
+
+// Reads a color (PF) or grayscale (Pf) PFM in either byte order.
+inline Image ReadPFM(const std::string &path)
+{
+    MappedFile file(path);
+    const char *pos = file.Data();
+    const char *end = file.Data() + file.Size();
+
+    // The header is three whitespace separated words and a scale, each ending in one whitespace byte.
+    auto word = [&]() -> std::string_view
+    {
+        while (pos < end && std::isspace(static_cast<unsigned char>(*pos)))
+        {
+            pos++;
+        }
+        const char *start = pos;
+        while (pos < end && !std::isspace(static_cast<unsigned char>(*pos)))
+        {
+            pos++;
+        }
+        return {start, size_t(pos - start)};
+    };
+
+    auto magic = word();
+    if (magic != "PF" && magic != "Pf")
+    {
+        throw std::runtime_error(path + " is not a PFM image.");
+    }
+    const int channels = magic == "PF" ? 3 : 1;
+
+    int width = 0, height = 0;
+    double scale = 0;
+    auto widthText = word(), heightText = word(), scaleText = word();
+    std::from_chars(widthText.data(), widthText.data() + widthText.size(), width);
+    std::from_chars(heightText.data(), heightText.data() + heightText.size(), height);
+    std::from_chars(scaleText.data(), scaleText.data() + scaleText.size(), scale);
+    pos++;
+
+    // The size check divides, since rowFloats * height can wrap for a broken header.
+    const size_t rowFloats = size_t(std::max(width, 0)) * channels;
+    if (width <= 0 || height <= 0 || scale == 0 || pos > end
+        || size_t(end - pos) / sizeof(float) / rowFloats < size_t(height))
+    {
+        throw std::runtime_error(path + " has a broken PFM header or is truncated.");
+    }
+
+    // A negative scale marks little-endian data. Rows are stored from the bottom up.
+    const bool swap = (scale < 0) != (std::endian::native == std::endian::little);
+    Image image(width, height);
+    std::vector<float> row(rowFloats);
+    for (int j = height - 1; j >= 0; j--)
+    {
+        std::memcpy(row.data(), pos, rowFloats * sizeof(float));
+        pos += rowFloats * sizeof(float);
+        for (int i = 0; i < width; i++)
+        {
+            float rgb[3];
+            for (int c = 0; c < 3; c++)
+            {
+                uint32_t bits = std::bit_cast<uint32_t>(row[size_t(i) * channels + (channels == 3 ? c : 0)]);
+                rgb[c] = std::bit_cast<float>(swap ? std::byteswap(bits) : bits);
+            }
+            image.SetPixel(i, j, Color(rgb[0], rgb[1], rgb[2]));
+        }
+    }
+    return image;
+}
+
+// Little-endian field reader over the bytes of an OpenEXR file.
+class ExrReader
+{
+public:
+    ExrReader(const char *begin, const char *end, const std::string &path) : begin(begin), pos(begin), end(end),
+                                                                             path(path)
+    {}
+
+    template<typename T>
+    T Get()
+    {
+        Need(sizeof(T));
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, pos, sizeof(T));
+        pos += sizeof(T);
+        if constexpr (std::endian::native == std::endian::big)
+        {
+            std::reverse(bytes, bytes + sizeof(T));
+        }
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    // A null terminated string; empty at the end of an attribute list.
+    std::string_view String()
+    {
+        auto terminator = static_cast<const char *>(std::memchr(pos, 0, size_t(end - pos)));
+        if (terminator == nullptr)
+        {
+            Fail("ends inside its header");
+        }
+        std::string_view text(pos, size_t(terminator - pos));
+        pos = terminator + 1;
+        return text;
+    }
+
+    void Skip(size_t bytes)
+    {
+        Need(bytes);
+        pos += bytes;
+    }
+
+    void Seek(uint64_t offset)
+    {
+        if (offset > uint64_t(end - begin))
+        {
+            Fail("has a scanline offset past its end");
+        }
+        pos = begin + offset;
+    }
+
+    const char *Position() const
+    { return pos; }
+
+    void Need(size_t bytes) const
+    {
+        if (size_t(end - pos) < bytes)
+        {
+            Fail("is truncated");
+        }
+    }
+
+    [[noreturn]] void Fail(const std::string &message) const
+    {
+        throw std::runtime_error(path + " " + message + ".");
+    }
+
+private:
+    const char *begin;
+    const char *pos;
+    const char *end;
+    std::string path;
+};
+
+// Reads a single part scanline OpenEXR file without compression, such as the ones WriteEXR() writes,
+// with HALF, FLOAT or UINT channels. The R, G and B channels become the image, and a file with a Y
+// channel but no color is read as gray.
+inline Image ReadEXR(const std::string &path)
+{
+    constexpr uint32_t TiledFlag = 0x200, DeepFlag = 0x800, MultipartFlag = 0x1000;
+
+    MappedFile file(path);
+    ExrReader reader(file.Data(), file.Data() + file.Size(), path);
+
+    if (reader.Get<uint32_t>() != 20000630)
+    {
+        reader.Fail("is not an OpenEXR image");
+    }
+    if ((reader.Get<uint32_t>() & (TiledFlag | DeepFlag | MultipartFlag)) != 0)
+    {
+        reader.Fail("is tiled, deep or multi-part, which is not supported");
+    }
+
+    struct Channel
+    {
+        std::string name;
+        int32_t type;   // 0 UINT, 1 HALF, 2 FLOAT
+    };
+    std::vector<Channel> channels;
+    int32_t window[4] = {0, 0, -1, -1};
+    uint8_t compression = 255;
+
+    for (auto name = reader.String(); !name.empty(); name = reader.String())
+    {
+        auto type = reader.String();
+        auto size = size_t(reader.Get<int32_t>());
+        reader.Need(size);
+        const char *valueEnd = reader.Position() + size;
+
+        if (name == "channels" && type == "chlist")
+        {
+            for (auto channel = reader.String(); !channel.empty(); channel = reader.String())
+            {
+                int32_t pixelType = reader.Get<int32_t>();
+                reader.Skip(4);
+                if (reader.Get<int32_t>() != 1 || reader.Get<int32_t>() != 1)
+                {
+                    reader.Fail("has subsampled channels, which are not supported");
+                }
+                channels.push_back({std::string(channel), pixelType});
+            }
+        }
+        else if (name == "compression")
+        {
+            compression = reader.Get<uint8_t>();
+        }
+        else if (name == "dataWindow" && type == "box2i")
+        {
+            for (auto &v: window)
+            {
+                v = reader.Get<int32_t>();
+            }
+        }
+        reader.Skip(size_t(valueEnd - reader.Position()));
+    }
+
+    if (compression != 0)
+    {
+        reader.Fail("is compressed, only uncompressed OpenEXR images can be read");
+    }
+    // In 64 bits, since the difference of two int32 corners can overflow.
+    const int64_t windowWidth = int64_t(window[2]) - window[0] + 1;
+    const int64_t windowHeight = int64_t(window[3]) - window[1] + 1;
+    if (windowWidth <= 0 || windowHeight <= 0 || channels.empty())
+    {
+        reader.Fail("has no pixels");
+    }
+    if (windowWidth > INT32_MAX || windowHeight > INT32_MAX)
+    {
+        reader.Fail("is too large");
+    }
+    const int width = int(windowWidth);
+    const int height = int(windowHeight);
+
+    // Which output channel every file channel feeds, -1 for none. Gray feeds all three.
+    std::vector<int> target(channels.size(), -1);
+    size_t pixelBytes = 0;
+    bool hasColor = false;
+    for (size_t c = 0; c < channels.size(); c++)
+    {
+        const auto &name = channels[c].name;
+        if (name == "R") target[c] = 0;
+        if (name == "G") target[c] = 1;
+        if (name == "B") target[c] = 2;
+        hasColor |= target[c] >= 0;
+        pixelBytes += channels[c].type == 1 ? 2 : 4;
+    }
+    for (size_t c = 0; c < channels.size() && !hasColor; c++)
+    {
+        if (channels[c].name == "Y")
+        {
+            target[c] = 3;
+        }
+    }
+
+    // Every scanline takes an offset, a header and its pixels in the rest of the file, which bounds
+    // the sizes of a broken header before anything is allocated from them.
+    const uint64_t remaining = uint64_t(file.Data() + file.Size() - reader.Position());
+    const uint64_t scanlineBytes = 8 + 8 + uint64_t(pixelBytes) * uint64_t(width);
+    if (remaining / scanlineBytes < uint64_t(height))
+    {
+        reader.Fail("is truncated");
+    }
+
+    Image image(width, height);
+    std::vector<uint64_t> offsets(height);
+    for (auto &offset: offsets)
+    {
+        offset = reader.Get<uint64_t>();
+    }
+
+    std::vector<float> rgb(size_t(width) * 3);
+    for (auto offset: offsets)
+    {
+        reader.Seek(offset);
+        int j = reader.Get<int32_t>() - window[1];
+        auto size = size_t(reader.Get<int32_t>());
+        if (j < 0 || j >= height || size != pixelBytes * width)
+        {
+            reader.Fail("has a broken scanline");
+        }
+
+        std::fill(rgb.begin(), rgb.end(), 0.0f);
+        for (size_t c = 0; c < channels.size(); c++)
+        {
+            for (int i = 0; i < width; i++)
+            {
+                float value;
+                switch (channels[c].type)
+                {
+                    case 0: value = float(reader.Get<uint32_t>()); break;
+                    case 1: value = HalfToFloat(reader.Get<uint16_t>()); break;
+                    default: value = reader.Get<float>(); break;
+                }
+                if (target[c] == 3)
+                {
+                    rgb[3 * i] = rgb[3 * i + 1] = rgb[3 * i + 2] = value;
+                }
+                else if (target[c] >= 0)
+                {
+                    rgb[3 * i + target[c]] = value;
+                }
+            }
+        }
+        std::copy(rgb.begin(), rgb.end(), image.Data() + size_t(j) * width * 3);
+    }
+    return image;
+}
+
+// Loads a PFM or OpenEXR image, told apart by the file extension.
+inline Image ReadHdrImage(const std::string &path)
+{
+    auto extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+    { return char(std::tolower(c)); });
+
+    if (extension == ".pfm")
+    {
+        return ReadPFM(path);
+    }
+    if (extension == ".exr")
+    {
+        return ReadEXR(path);
+    }
+    throw std::runtime_error(path + " is neither a PFM nor an OpenEXR image.");
+}
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include "Image.hpp"
+#include "HalfFloat.hpp"
+#include "ToneMap.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+inline std::ofstream OpenImageFile(const std::string &path)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open " + path + " for writing.");
+    }
+    return file;
+}
+
+// Writes a binary (P6) PPM with tone mapped 8-bit channels.
+inline void WritePPM(const Image &image, const std::string &path, const ToneMapSettings &toneMap = {})
+{
+    auto file = OpenImageFile(path);
+    auto bytes = image.ToBytes(toneMap);
+
+    file << "P6\n" << image.Width() << ' ' << image.Height() << "\n255\n";
+    file.write(reinterpret_cast<const char *>(bytes.data()), std::streamsize(bytes.size()));
+}
+
+// Writes a PFM with the linear float values, which keeps everything above 1.0.
+inline void WritePFM(const Image &image, const std::string &path)
+{
+    auto file = OpenImageFile(path);
+
+    // A negative scale marks little-endian data. PFM stores rows from the bottom up.
+    file << "PF\n" << image.Width() << ' ' << image.Height() << '\n'
+         << (std::endian::native == std::endian::little ? "-1.0" : "1.0") << '\n';
+
+    auto rowFloats = size_t(image.Width()) * 3;
+    for (int j = image.Height() - 1; j >= 0; j--)
+    {
+        file.write(reinterpret_cast<const char *>(image.Data() + size_t(j) * rowFloats),
+                   std::streamsize(rowFloats * sizeof(float)));
+    }
+}
+
+// Appends the little-endian bytes of value, the byte order of every OpenEXR field.
+template<typename T>
+void ExrPut(std::vector<uint8_t> &out, T value)
+{
+    uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    if constexpr (std::endian::native == std::endian::big)
+    {
+        std::reverse(bytes, bytes + sizeof(T));
+    }
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+inline void ExrPutAttribute(std::vector<uint8_t> &out, const char *name, const char *type,
+                            const std::vector<uint8_t> &value)
+{
+    out.insert(out.end(), name, name + std::strlen(name) + 1);
+    out.insert(out.end(), type, type + std::strlen(type) + 1);
+    ExrPut(out, int32_t(value.size()));
+    out.insert(out.end(), value.begin(), value.end());
+}
+
+// Writes the linear values as an uncompressed, single part, scanline OpenEXR file with half float
+// R, G and B channels, which every HDR viewer and compositor reads. Half keeps about three decimal
+// digits over the whole range up to 65504, at half the size of PFM.
+inline void WriteEXR(const Image &image, const std::string &path)
+{
+    auto file = OpenImageFile(path);
+    const int width = image.Width();
+    const int height = image.Height();
+
+    std::vector<uint8_t> out;
+    ExrPut(out, uint32_t(20000630));   // Magic number
+    ExrPut(out, uint32_t(2));          // Version 2, single part scanline
+
+    // Channels are listed, and stored in every scanline, in alphabetical order.
+    std::vector<uint8_t> channels;
+    for (const char *name: {"B", "G", "R"})
+    {
+        channels.insert(channels.end(), name, name + 2);
+        ExrPut(channels, int32_t(1));  // HALF
+        ExrPut(channels, uint32_t(0)); // pLinear and reserved bytes
+        ExrPut(channels, int32_t(1));  // x sampling
+        ExrPut(channels, int32_t(1));  // y sampling
+    }
+    channels.push_back(0);
+
+    std::vector<uint8_t> window;
+    for (int32_t v: {0, 0, width - 1, height - 1})
+    {
+        ExrPut(window, v);
+    }
+
+    std::vector<uint8_t> floatOne, screenCenter;
+    ExrPut(floatOne, 1.0f);
+    ExrPut(screenCenter, 0.0f);
+    ExrPut(screenCenter, 0.0f);
+
+    ExrPutAttribute(out, "channels", "chlist", channels);
+    ExrPutAttribute(out, "compression", "compression", {0});   // NO_COMPRESSION
+    ExrPutAttribute(out, "dataWindow", "box2i", window);
+    ExrPutAttribute(out, "displayWindow", "box2i", window);
+    ExrPutAttribute(out, "lineOrder", "lineOrder", {0});       // INCREASING_Y
+    ExrPutAttribute(out, "pixelAspectRatio", "float", floatOne);
+    ExrPutAttribute(out, "screenWindowCenter", "v2f", screenCenter);
+    ExrPutAttribute(out, "screenWindowWidth", "float", floatOne);
+    out.push_back(0);
+
+    // Offset table, then one chunk per scanline: y, byte count, and the B, G and R halves of the row.
+    const size_t rowBytes = size_t(width) * 3 * sizeof(uint16_t);
+    const size_t chunkBytes = 8 + rowBytes;
+    const size_t firstChunk = out.size() + size_t(height) * sizeof(uint64_t);
+    for (int j = 0; j < height; j++)
+    {
+        ExrPut(out, uint64_t(firstChunk + size_t(j) * chunkBytes));
+    }
+
+    std::vector<float> planar(size_t(width) * 3);
+    std::vector<uint16_t> halves(planar.size());
+    out.reserve(firstChunk + size_t(height) * chunkBytes);
+    for (int j = 0; j < height; j++)
+    {
+        const float *row = image.Data() + size_t(j) * width * 3;
+        for (int i = 0; i < width; i++)
+        {
+            planar[i] = row[3 * i + 2];
+            planar[width + i] = row[3 * i + 1];
+            planar[2 * width + i] = row[3 * i];
+        }
+        FloatsToHalves(planar.data(), halves.data(), planar.size());
+
+        ExrPut(out, int32_t(j));
+        ExrPut(out, int32_t(rowBytes));
+        for (auto half: halves)
+        {
+            ExrPut(out, half);
+        }
+    }
+
+    file.write(reinterpret_cast<const char *>(out.data()), std::streamsize(out.size()));
+    if (!file)
+    {
+        throw std::runtime_error("Failed to write " + path + ".");
+    }
+}
+
+inline uint32_t PngCrc32(const uint8_t *data, size_t length, uint32_t crc = 0)
+{
+    static const auto table = []
+    {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (size_t n = 0; n < length; n++)
+    {
+        crc = table[(crc ^ data[n]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+inline uint32_t PngAdler32(const uint8_t *data, size_t length)
+{
+    uint32_t a = 1, b = 0;
+    while (length > 0)
+    {
+        // 5552 is the largest block for which b cannot overflow before the modulo.
+        size_t block = length < 5552 ? length : 5552;
+        for (size_t n = 0; n < block; n++)
+        {
+            a += data[n];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += block;
+        length -= block;
+    }
+    return (b << 16) | a;
+}
+
+inline void PngPutU32(std::vector<uint8_t> &out, uint32_t v)
+{
+    out.push_back(uint8_t(v >> 24));
+    out.push_back(uint8_t(v >> 16));
+    out.push_back(uint8_t(v >> 8));
+    out.push_back(uint8_t(v));
+}
+
+inline void PngWriteChunk(std::ofstream &file, const char *type, const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> chunk;
+    chunk.reserve(data.size() + 12);
+    PngPutU32(chunk, uint32_t(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    PngPutU32(chunk, PngCrc32(chunk.data() + 4, data.size() + 4));
+    file.write(reinterpret_cast<const char *>(chunk.data()), std::streamsize(chunk.size()));
+}
+
+// Writes a tone mapped 8-bit RGB PNG. The zlib stream uses stored (uncompressed) deflate blocks, which
+// keeps the encoder tiny and fast at the cost of file size.
+inline void WritePNG(const Image &image, const std::string &path, const ToneMapSettings &toneMap = {})
+{
+    auto file = OpenImageFile(path);
+    auto bytes = image.ToBytes(toneMap);
+
+    // Every scanline is prefixed with filter type 0 (None).
+    size_t rowBytes = size_t(image.Width()) * 3;
+    std::vector<uint8_t> raw;
+    raw.reserve((rowBytes + 1) * image.Height());
+    for (int j = 0; j < image.Height(); j++)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), bytes.begin() + j * rowBytes, bytes.begin() + (j + 1) * rowBytes);
+    }
+
+    std::vector<uint8_t> idat = {0x78, 0x01};  // zlib header: deflate, 32K window, no dictionary
+    idat.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    size_t offset = 0;
+    do
+    {
+        size_t length = std::min<size_t>(raw.size() - offset, 65535);
+        bool last = offset + length == raw.size();
+        idat.push_back(last ? 1 : 0);
+        idat.push_back(uint8_t(length));
+        idat.push_back(uint8_t(length >> 8));
+        idat.push_back(uint8_t(~length));
+        idat.push_back(uint8_t(~length >> 8));
+        idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + length);
+        offset += length;
+    } while (offset < raw.size());
+    PngPutU32(idat, PngAdler32(raw.data(), raw.size()));
+
+    std::vector<uint8_t> ihdr;
+    PngPutU32(ihdr, uint32_t(image.Width()));
+    PngPutU32(ihdr, uint32_t(image.Height()));
+    ihdr.insert(ihdr.end(), {8, 2, 0, 0, 0});  // 8-bit depth, RGB, deflate, adaptive filtering, no interlace
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    file.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+    PngWriteChunk(file, "IHDR", ihdr);
+    PngWriteChunk(file, "IDAT", idat);
+    PngWriteChunk(file, "IEND", {});
+}
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef INSTANCE_SET_H
+#define INSTANCE_SET_H
+
+#include "RTweekend.hpp"
+#include "HitTable.hpp"
+#include "FlatBvh.hpp"
+#include "Arena.hpp"
+#include "TriangleMesh.hpp"
+#include "Transform.hpp"
+#include "RenderStats.hpp"
+
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Material of an instance that keeps the material of its mesh.
+constexpr MaterialId InheritMaterial = std::numeric_limits<MaterialId>::max();
+
+// One placement of a mesh. Only the world to object transform is stored, since every Ray needs it;
+// its inverse is computed for the one closest hit of a Ray.
+struct MeshInstance
+{
+    Transform worldToObject;
+    uint32_t mesh;
+    MaterialId material;    // InheritMaterial for the material of the mesh
+};
+
+// Two-level acceleration structure. Every mesh is stored once, with its own hierarchy (the bottom
+// level), and placed any number of times by instances, each an affine transform and a mesh index.
+// The top level is a FlatBvh over the world space boxes of the instances. A Ray that reaches an
+// instance is transformed into the mesh's space and traced through the mesh's hierarchy, so memory
+// grows with the unique triangles and only by a transform per instance.
+class InstanceSet : public HitTable
+{
+public:
+    static constexpr int DefaultLeafSize = 2;
+
+    // Adds a mesh without placing it, and returns the index instances refer to it by.
+    uint32_t AddMesh(TriangleMesh mesh)
+    {
+        meshes.push_back(std::move(mesh));
+        return uint32_t(meshes.size() - 1);
+    }
+
+    // Places mesh with objectToWorld. Throws if the transform can't be inverted. A mesh without
+    // triangles, such as an OBJ point cloud, has nothing to hit and isn't placed: its empty box would
+    // have no centroid to build the top level hierarchy around.
+    void AddInstance(uint32_t mesh, const Transform &objectToWorld, MaterialId material = InheritMaterial)
+    {
+        if (meshes[mesh].TriangleCount() == 0)
+        {
+            return;
+        }
+        instances.push_back({objectToWorld.Inverse(), mesh, material});
+        bbox = Aabb(bbox, objectToWorld.ApplyBox(meshes[mesh].BoundingBox()));
+    }
+
+    size_t MeshCount() const
+    { return meshes.size(); }
+
+    size_t InstanceCount() const
+    { return instances.size(); }
+
+    const TriangleMesh &Mesh(size_t i) const
+    { return meshes[i]; }
+
+    const MeshInstance &Instance(size_t i) const
+    { return instances[i]; }
+
+    // Triangles stored, each mesh counted once.
+    size_t UniqueTriangleCount() const
+    {
+        size_t count = 0;
+        for (const auto &mesh: meshes)
+        {
+            count += mesh.TriangleCount();
+        }
+        return count;
+    }
+
+    // Triangles in the scene, each mesh counted once per instance.
+    size_t InstancedTriangleCount() const
+    {
+        size_t count = 0;
+        for (const auto &instance: instances)
+        {
+            count += meshes[instance.mesh].TriangleCount();
+        }
+        return count;
+    }
+
+    size_t MemoryBytes() const
+    {
+        size_t bytes = instances.capacity() * sizeof(MeshInstance) + tlas.MemoryBytes();
+        for (const auto &mesh: meshes)
+        {
+            bytes += mesh.MemoryBytes();
+        }
+        return bytes;
+    }
+
+    // Builds the hierarchy of every mesh, then the top level over the instances, reordering them so
+    // that every leaf is contiguous. The builds share scratch, reset after each, so building many
+    // meshes reuses one block of memory.
+    void Build(Arena &scratch, int maxLeafSize = DefaultLeafSize)
+    {
+        for (auto &mesh: meshes)
+        {
+            mesh.Build(scratch);
+            scratch.Reset();
+        }
+
+        auto order = tlas.Build(instances.size(), [this](uint32_t i)
+        {
+            return instances[i].worldToObject.Inverse().ApplyBox(meshes[instances[i].mesh].BoundingBox());
+        }, maxLeafSize, scratch);
+
+        std::vector<MeshInstance> permuted;
+        permuted.reserve(instances.size());
+        for (auto i: order)
+        {
+            permuted.push_back(instances[i]);
+        }
+        instances.swap(permuted);
+    }
+
+    void Build(int maxLeafSize = DefaultLeafSize)
+    {
+        Arena scratch;
+        Build(scratch, maxLeafSize);
+    }
+
+    bool Hit(const Ray &r, Interval rayT, HitRecord &rec) const override
+    {
+        // The closest hit stays in the space of its mesh until the traversal is done.
+        int closest = -1;
+        HitRecord objectRec;
+
+        auto hitLeaf = [&](uint32_t first, uint32_t count, Interval &t)
+        {
+            RT_STAT(threadStats.instanceTests += count);
+            bool hit = false;
+            for (uint32_t k = first; k < first + count; k++)
+            {
+                const auto &instance = instances[k];
+                const auto &toObject = instance.worldToObject;
+
+                // The direction isn't normalized, so t means the same distance along both Rays.
+                Ray objectRay(toObject.ApplyPoint(r.origin()), toObject.ApplyVector(r.direction()), r.time());
+                if (meshes[instance.mesh].Hit(objectRay, t, objectRec))
+                {
+                    t.max = objectRec.t;
+                    closest = int(k);
+                    hit = true;
+                }
+            }
+            return hit;
+        };
+
+        if (tlas.Empty())
+        {
+            hitLeaf(0, uint32_t(instances.size()), rayT);
+        }
+        else
+        {
+            tlas.Traverse(r, rayT, hitLeaf);
+        }
+
+        if (closest < 0)
+        {
+            return false;
+        }
+
+        const auto &instance = instances[closest];
+        auto toWorld = instance.worldToObject.Inverse();
+
+        // Normals take the transpose of the inverse, which keeps them on the side of the surface the
+        // Ray came from, so frontFace carries over unchanged.
+        rec = objectRec;
+        rec.p = toWorld.ApplyPoint(objectRec.p);
+        rec.pError = toWorld.MaxScale() * objectRec.pError
+                     + HitPositionError(toWorld.MaxScale() * MaxAbsComponent(objectRec.p)
+                                        + MaxAbsComponent(toWorld.Translation()));
+        rec.normal = UnitVector(instance.worldToObject.ApplyTransposed(objectRec.normal));
+        if (instance.material != InheritMaterial)
+        {
+            rec.mat = instance.material;
+        }
+        return true;
+    }
+
+    Aabb BoundingBox() const override
+    { return bbox; }
+
+private:
+    std::vector<TriangleMesh> meshes;
+    std::vector<MeshInstance> instances;
+    FlatBvh tlas;
+    Aabb bbox;
+};
+
+#endif
@@ -1,43 +1,61 @@
 #ifndef INTERVAL_H
 #define INTERVAL_H
 
-class Interval
+template<typename T>
+class IntervalT
 {
 public:
-    double min, max;
+    T min, max;
 
-    Interval() : min(+RT_INFINITY), max(-RT_INFINITY)
+    IntervalT() : min(+RT_INFINITY), max(-RT_INFINITY)
     {} // Default Interval is empty
 
-    Interval(double min, double max) : min(min), max(max)
+    IntervalT(T min, T max) : min(min), max(max)
     {}
 
-    double Size() const
+    IntervalT(const IntervalT &a, const IntervalT &b)
+    {
+        // Create the Interval tightly enclosing the two input intervals.
+        min = a.min <= b.min ? a.min : b.min;
+        max = a.max >= b.max ? a.max : b.max;
+    }
+
+    T Size() const
     {
         return max - min;
     }
 
-    bool Contains(double x) const
+    bool Contains(T x) const
     {
         return min <= x && x <= max;
     }
 
-    bool Surrounds(double x) const
+    bool Surrounds(T x) const
     {
         return min < x && x < max;
     }
 
-    double Clamp(double x) const
+    T Clamp(T x) const
     {
         if (x < min) return min;
         if (x > max) return max;
         return x;
     }
 
-    static const Interval empty, universe;
+    IntervalT Expand(T delta) const
+    {
+        auto padding = delta / 2;
+        return IntervalT(min - padding, max + padding);
+    }
+
+    static const IntervalT empty, universe;
 };
 
-const Interval Interval::empty = Interval(+RT_INFINITY, -RT_INFINITY);
-const Interval Interval::universe = Interval(-RT_INFINITY, +RT_INFINITY);
+template<typename T>
+const IntervalT<T> IntervalT<T>::empty = IntervalT<T>(+RT_INFINITY, -RT_INFINITY);
+template<typename T>
+const IntervalT<T> IntervalT<T>::universe = IntervalT<T>(-RT_INFINITY, +RT_INFINITY);
+
+using Interval = IntervalT<Real>;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,96 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__APPLE__) || defined(__linux__)
+#define RT_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file. The file is memory mapped where mmap is available, so large scene
+// files are paged in by the OS as the loader walks them instead of being copied into a buffer first.
+// Elsewhere the file is read into memory.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path)
+    {
+#ifdef RT_HAVE_MMAP
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open " + path + " for reading.");
+        }
+
+        struct stat info{};
+        if (fstat(fd, &info) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to read the size of " + path + ".");
+        }
+
+        size = size_t(info.st_size);
+        if (size > 0)
+        {
+            void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED)
+            {
+                close(fd);
+                throw std::runtime_error("Failed to map " + path + ".");
+            }
+            madvise(mapped, size, MADV_SEQUENTIAL);
+            data = static_cast<const char *>(mapped);
+        }
+        close(fd);
+#else
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+        {
+            throw std::runtime_error("Failed to open " + path + " for reading.");
+        }
+
+        buffer.resize(size_t(file.tellg()));
+        file.seekg(0);
+        file.read(buffer.data(), std::streamsize(buffer.size()));
+        data = buffer.data();
+        size = buffer.size();
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile()
+    {
+#ifdef RT_HAVE_MMAP
+        if (data != nullptr)
+        {
+            munmap(const_cast<char *>(data), size);
+        }
+#endif
+    }
+
+    const char *Data() const
+    { return data; }
+
+    size_t Size() const
+    { return size; }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+#ifndef RT_HAVE_MMAP
+    std::vector<char> buffer;
+#endif
+};
+
+#endif
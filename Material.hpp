@@ -3,89 +3,92 @@
 
 #include "RTweekend.hpp"
 #include "HitTable.hpp"
+#include "RenderStats.hpp"
+#include "AlignedAllocator.hpp"
 
-class HitRecord;
+#include <variant>
+#include <vector>
 
-class Material
+// Uniform numbers in [0,1) for one scatter, supplied by the caller's Sampler: a 2D sample for the
+// direction and a 1D sample for discrete choices such as reflect or refract.
+struct ScatterSample
 {
-public:
-    virtual ~Material() = default;
-
-    virtual bool Scatter(
-            const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered
-    ) const
-    {
-        return false;
-    }
+    Real u1, u2;
+    Real uChoice;
 };
 
-class Lambertian : public Material
+class Lambertian
 {
 public:
     Lambertian(const Color &albedo) : albedo(albedo)
     {}
 
-    bool Scatter(const Ray &rIn, const HitRecord &rec, Color &attenuation, Ray &scattered)
-    const override
+    bool Scatter(const Ray &rIn, const HitRecord &rec, const ScatterSample &u, Color &attenuation, Ray &scattered)
+    const
     {
-        auto scatterDirection = rec.normal + RandomUnitVector();
+        // Cosine weighted, the same distribution as normal + RandomUnitVector() without its
+        // degenerate directions.
+        auto scatterDirection = SampleCosineHemisphere(rec.normal, u.u1, u.u2);
 
-        // Catch degenerate Scatter direction
-        if (scatterDirection.NearZero())
-        {
-            scatterDirection = rec.normal;
-        }
-
-        scattered = Ray(rec.p, scatterDirection);
+        scattered = rec.SpawnRay(scatterDirection, rIn.time());
         attenuation = albedo;
         return true;
     }
 
+    const Color &Albedo() const
+    { return albedo; }
+
 private:
     Color albedo;
 };
 
-class Metal : public Material
+class Metal
 {
 public:
-    Metal(const Color &albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1)
+    Metal(const Color &albedo, Real fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1)
     {}
 
-    bool Scatter(const Ray &rIn, const HitRecord &rec, Color &attenuation, Ray &scattered)
-    const override
+    bool Scatter(const Ray &rIn, const HitRecord &rec, const ScatterSample &u, Color &attenuation, Ray &scattered)
+    const
     {
         Vec3 reflected = Reflect(rIn.direction(), rec.normal);
-        reflected = UnitVector(reflected) + (fuzz * RandomUnitVector());
-        scattered = Ray(rec.p, reflected);
+        reflected = UnitVector(reflected) + (fuzz * SampleUniformSphere(u.u1, u.u2));
+        scattered = rec.SpawnRay(reflected, rIn.time());
         attenuation = albedo;
-        return (Dot(scattered.direction(), rec.normal) > 0.0);
+        return (Dot(scattered.direction(), rec.normal) > 0);
     }
 
+    const Color &Albedo() const
+    { return albedo; }
+
+    Real Fuzz() const
+    { return fuzz; }
+
 private:
     Color albedo;
-    double fuzz;
+    Real fuzz;
 };
 
-class Dielectric : public Material
+class Dielectric
 {
 public:
-    Dielectric(double refractionIndex) : refractionIndex(refractionIndex)
+    Dielectric(Real refractionIndex) : refractionIndex(refractionIndex)
     {}
 
-    bool Scatter(const Ray &rIn, const HitRecord &rec, Color &attenuation, Ray &scattered)
-    const override
+    bool Scatter(const Ray &rIn, const HitRecord &rec, const ScatterSample &u, Color &attenuation, Ray &scattered)
+    const
     {
         attenuation = Color(1.0, 1.0, 1.0);
-        double ri = rec.frontFace ? (1.0 / refractionIndex) : refractionIndex;
+        Real ri = rec.frontFace ? (1 / refractionIndex) : refractionIndex;
 
         Vec3 unitDirection = UnitVector(rIn.direction());
-        double cosTheta = fmin(Dot(-unitDirection, rec.normal), 1.0);
-        double sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+        Real cosTheta = std::min(Dot(-unitDirection, rec.normal), Real(1));
+        Real sinTheta = sqrt(1 - cosTheta * cosTheta);
 
-        bool cannotRefract = ri * sinTheta > 1.0;
+        bool cannotRefract = ri * sinTheta > 1;
         Vec3 direction;
 
-        if (cannotRefract || Reflectance(cosTheta, ri) > RandomDouble())
+        if (cannotRefract || Reflectance(cosTheta, ri) > u.uChoice)
         {
             direction = Reflect(unitDirection, rec.normal);
         }
@@ -94,22 +97,92 @@ public:
             direction = Refract(unitDirection, rec.normal, ri);
         }
 
-        scattered = Ray(rec.p, direction);
+        scattered = rec.SpawnRay(direction, rIn.time());
         return true;
     }
 
+    Real RefractionIndex() const
+    { return refractionIndex; }
+
 private:
     // Refractive index in vacuum or air, or the ratio of the Material's refractive index over
     // the refractive index of the enclosing media
-    double refractionIndex;
+    Real refractionIndex;
 
-    static double Reflectance(double cosine, double refractionIndex)
+    static Real Reflectance(Real cosine, Real refractionIndex)
     {
         // Use Schlick's approximation for Reflectance.
         auto r0 = (1 - refractionIndex) / (1 + refractionIndex);
         r0 = r0 * r0;
-        return r0 + (1 - r0) * pow((1 - cosine), 5);
+        return r0 + (1 - r0) * std::pow((1 - cosine), 5);
+    }
+};
+
+// Materials are plain values held in a variant, so a scatter is a switch on the alternative instead
+// of a virtual call, and a HitRecord refers to its material by MaterialId instead of a shared_ptr.
+using Material = std::variant<Lambertian, Metal, Dielectric>;
+static_assert(std::variant_size_v<Material> == StatsMaterialTypes, "Update statsMaterialNames in RenderStats.hpp");
+
+inline bool Scatter(const Material &mat, const Ray &rIn, const HitRecord &rec, const ScatterSample &u,
+                    Color &attenuation, Ray &scattered)
+{
+    RT_STAT(threadStats.scatterCalls[mat.index()]++);
+    switch (mat.index())
+    {
+        case 0:
+            return std::get_if<0>(&mat)->Scatter(rIn, rec, u, attenuation, scattered);
+        case 1:
+            return std::get_if<1>(&mat)->Scatter(rIn, rec, u, attenuation, scattered);
+        case 2:
+            return std::get_if<2>(&mat)->Scatter(rIn, rec, u, attenuation, scattered);
+        default:
+            return false;
     }
+}
+
+// Fraction of the light the surface reflects, the albedo guide of the denoiser. Glass passes it all.
+inline Color Albedo(const Material &mat)
+{
+    switch (mat.index())
+    {
+        case 0:
+            return std::get_if<0>(&mat)->Albedo();
+        case 1:
+            return std::get_if<1>(&mat)->Albedo();
+        default:
+            return Color(1, 1, 1);
+    }
+}
+
+// Glass, and metal polished enough to show a sharp mirror image. The denoiser guides are taken from
+// what such a surface reflects or refracts rather than from the surface itself.
+inline bool IsSpecular(const Material &mat)
+{
+    constexpr Real MaxSpecularFuzz = 0.1;
+    return mat.index() == 2 || (mat.index() == 1 && std::get_if<1>(&mat)->Fuzz() < MaxSpecularFuzz);
+}
+
+// Flat table of all materials in a scene, indexed by MaterialId, in one cache line aligned array.
+class MaterialTable
+{
+public:
+    MaterialId Add(const Material &mat)
+    {
+        materials.push_back(mat);
+        return MaterialId(materials.size() - 1);
+    }
+
+    void Reserve(size_t count)
+    { materials.reserve(count); }
+
+    const Material &operator[](MaterialId id) const
+    { return materials[id]; }
+
+    size_t Size() const
+    { return materials.size(); }
+
+private:
+    AlignedVector<Material> materials;
 };
 
 #endif
\ No newline at end of file
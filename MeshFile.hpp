@@ -0,0 +1,412 @@
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+
+#include "RTweekend.hpp"
+#include "TriangleMesh.hpp"
+#include "MappedFile.hpp"
+#include "SceneTokenizer.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Triangle mesh import from Wavefront OBJ and PLY files. Both loaders stream through the memory
+// mapped file once, appending straight to the vertex and index buffers of the mesh; polygons are
+// split into fans of triangles. Only positions and faces are read: normals, texture coordinates,
+// groups and OBJ materials are skipped, and the whole mesh gets the material it is loaded with.
+
+// Converts one OBJ face corner ("7", "7/2", "7//3" or "7/2/3") to a zero based vertex index. Negative
+// indices count back from the last vertex read so far.
+inline uint32_t ObjVertexIndex(SceneTokenizer &tokens, std::string_view corner, size_t vertexCount)
+{
+    int64_t index = 0;
+    auto [ptr, ec] = std::from_chars(corner.data(), corner.data() + corner.size(), index);
+    if (ec != std::errc() || (ptr != corner.data() + corner.size() && *ptr != '/'))
+    {
+        tokens.Fail("expected a vertex index instead of '" + std::string(corner) + "'");
+    }
+
+    int64_t resolved = index < 0 ? int64_t(vertexCount) + index : index - 1;
+    if (index == 0 || resolved < 0 || resolved > int64_t(UINT32_MAX))
+    {
+        tokens.Fail("vertex index " + std::to_string(index) + " is out of range");
+    }
+    return uint32_t(resolved);
+}
+
+inline TriangleMesh LoadObjMesh(const std::string &path, MaterialId mat)
+{
+    MappedFile file(path);
+    SceneTokenizer tokens(file.Data(), file.Data() + file.Size(), path);
+
+    std::vector<Point3> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> face;
+    while (tokens.NextLine())
+    {
+        auto statement = tokens.Word();
+        if (statement == "v")
+        {
+            // A fourth (w) coordinate and vertex colors after the position are ignored.
+            vertices.push_back(tokens.Vector());
+        }
+        else if (statement == "f")
+        {
+            face.clear();
+            while (!tokens.AtLineEnd())
+            {
+                face.push_back(ObjVertexIndex(tokens, tokens.Word(), vertices.size()));
+            }
+            if (face.size() < 3)
+            {
+                tokens.Fail("a face needs at least three vertices");
+            }
+
+            for (size_t k = 1; k + 1 < face.size(); k++)
+            {
+                indices.insert(indices.end(), {face[0], face[k], face[k + 1]});
+            }
+        }
+    }
+
+    for (auto index: indices)
+    {
+        if (index >= vertices.size())
+        {
+            throw std::runtime_error(path + ": a face refers to vertex " + std::to_string(index + 1) + " of only "
+                                     + std::to_string(vertices.size()) + ".");
+        }
+    }
+    return TriangleMesh(std::move(vertices), std::move(indices), mat);
+}
+
+// Whether value, as read from a PLY file, is a whole number in [0, limit). Checked on the double,
+// since converting a negative, NaN or out of range value to an integer is undefined.
+inline bool IsPlyIndex(double value, double limit)
+{
+    return value >= 0 && value < limit && value == std::floor(value);
+}
+
+// Shortest text of a value read from a PLY file, for error messages.
+inline std::string PlyNumberString(double value)
+{
+    char text[32];
+    auto end = std::to_chars(text, text + sizeof(text), value).ptr;
+    return std::string(text, end);
+}
+
+enum class PlyType
+{
+    Int8, Uint8, Int16, Uint16, Int32, Uint32, Float32, Float64
+};
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type = PlyType::Float32;
+    PlyType countType = PlyType::Uint8;  // Type of the item count of a list
+    bool list = false;
+};
+
+struct PlyElement
+{
+    std::string name;
+    size_t count = 0;
+    std::vector<PlyProperty> properties;
+};
+
+inline PlyType ParsePlyType(SceneTokenizer &tokens, std::string_view name)
+{
+    if (name == "char" || name == "int8") return PlyType::Int8;
+    if (name == "uchar" || name == "uint8") return PlyType::Uint8;
+    if (name == "short" || name == "int16") return PlyType::Int16;
+    if (name == "ushort" || name == "uint16") return PlyType::Uint16;
+    if (name == "int" || name == "int32") return PlyType::Int32;
+    if (name == "uint" || name == "uint32") return PlyType::Uint32;
+    if (name == "float" || name == "float32") return PlyType::Float32;
+    if (name == "double" || name == "float64") return PlyType::Float64;
+    tokens.Fail("unknown PLY type '" + std::string(name) + "'");
+}
+
+// Reads the values of a PLY body one at a time, from text or from binary in either byte order.
+class PlyReader
+{
+public:
+    enum class Format
+    {
+        Ascii, BinaryLittleEndian, BinaryBigEndian
+    };
+
+    PlyReader(const char *begin, const char *end, Format format, const std::string &path)
+            : pos(begin), end(end), format(format), path(path), tokens(begin, end, path)
+    {}
+
+    // Starts the next element; in text, every element is on a line of its own.
+    void BeginElement()
+    {
+        if (format == Format::Ascii && !tokens.NextLine())
+        {
+            throw std::runtime_error(path + " ends before its last element.");
+        }
+    }
+
+    double Read(PlyType type)
+    {
+        if (format == Format::Ascii)
+        {
+            return tokens.Number();
+        }
+
+        switch (type)
+        {
+            case PlyType::Int8: return Binary<int8_t>();
+            case PlyType::Uint8: return Binary<uint8_t>();
+            case PlyType::Int16: return Binary<int16_t>();
+            case PlyType::Uint16: return Binary<uint16_t>();
+            case PlyType::Int32: return Binary<int32_t>();
+            case PlyType::Uint32: return Binary<uint32_t>();
+            case PlyType::Float32: return Binary<float>();
+            case PlyType::Float64: return Binary<double>();
+        }
+        return 0;
+    }
+
+private:
+    const char *pos;
+    const char *end;
+    Format format;
+    std::string path;
+    SceneTokenizer tokens;
+
+    template<typename T>
+    T Binary()
+    {
+        if (size_t(end - pos) < sizeof(T))
+        {
+            throw std::runtime_error(path + " ends before its last element.");
+        }
+
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, pos, sizeof(T));
+        pos += sizeof(T);
+
+        constexpr bool littleEndianHost = std::endian::native == std::endian::little;
+        if ((format == Format::BinaryLittleEndian) != littleEndianHost)
+        {
+            std::reverse(bytes, bytes + sizeof(T));
+        }
+
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+};
+
+inline TriangleMesh LoadPlyMesh(const std::string &path, MaterialId mat)
+{
+    MappedFile file(path);
+    std::string_view contents(file.Data(), file.Size());
+
+    // The header is text up to the end_header line, whatever the encoding of the body.
+    auto headerEnd = contents.find("end_header");
+    auto bodyStart = headerEnd == std::string_view::npos ? headerEnd : contents.find('\n', headerEnd);
+    if (!contents.starts_with("ply") || bodyStart == std::string_view::npos)
+    {
+        throw std::runtime_error(path + " is not a PLY file.");
+    }
+    bodyStart++;
+
+    SceneTokenizer header(file.Data(), file.Data() + headerEnd, path);
+    header.NextLine();
+    header.Word();
+
+    PlyReader::Format format = PlyReader::Format::Ascii;
+    std::vector<PlyElement> elements;
+    while (header.NextLine())
+    {
+        auto keyword = header.Word();
+        if (keyword == "format")
+        {
+            auto name = header.Word();
+            if (name == "ascii") format = PlyReader::Format::Ascii;
+            else if (name == "binary_little_endian") format = PlyReader::Format::BinaryLittleEndian;
+            else if (name == "binary_big_endian") format = PlyReader::Format::BinaryBigEndian;
+            else header.Fail("unknown PLY format '" + std::string(name) + "'");
+        }
+        else if (keyword == "element")
+        {
+            PlyElement element;
+            element.name = header.Word();
+            auto count = header.Number();
+            if (!IsPlyIndex(count, double(UINT32_MAX) + 1))
+            {
+                header.Fail("invalid element count");
+            }
+            element.count = size_t(count);
+            elements.push_back(std::move(element));
+        }
+        else if (keyword == "property")
+        {
+            if (elements.empty())
+            {
+                header.Fail("property before the first element");
+            }
+
+            PlyProperty property;
+            auto type = header.Word();
+            if (type == "list")
+            {
+                property.list = true;
+                property.countType = ParsePlyType(header, header.Word());
+                type = header.Word();
+            }
+            property.type = ParsePlyType(header, type);
+            property.name = header.Word();
+            elements.back().properties.push_back(std::move(property));
+        }
+        // comment and obj_info lines carry nothing the mesh needs.
+    }
+
+    // Faces may be listed before the vertices, so indices are checked against the count in the header.
+    size_t vertexCount = 0;
+    for (const auto &element: elements)
+    {
+        vertexCount += element.name == "vertex" ? element.count : 0;
+    }
+    const double indexLimit = std::min(double(vertexCount), double(UINT32_MAX) + 1);
+
+    std::vector<Point3> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> face;
+    PlyReader reader(file.Data() + bodyStart, file.Data() + file.Size(), format, path);
+    for (const auto &element: elements)
+    {
+        const bool isVertex = element.name == "vertex";
+        const bool isFace = element.name == "face";
+        if (isVertex)
+        {
+            vertices.reserve(element.count);
+        }
+        else if (isFace)
+        {
+            indices.reserve(3 * element.count);
+        }
+
+        for (size_t n = 0; n < element.count; n++)
+        {
+            reader.BeginElement();
+            Point3 position;
+            for (const auto &property: element.properties)
+            {
+                if (!property.list)
+                {
+                    auto value = reader.Read(property.type);
+                    if (isVertex && property.name.size() == 1 && property.name[0] >= 'x' && property.name[0] <= 'z')
+                    {
+                        position[property.name[0] - 'x'] = Real(value);
+                    }
+                    continue;
+                }
+
+                auto listLength = reader.Read(property.countType);
+                if (!IsPlyIndex(listLength, double(UINT32_MAX) + 1))
+                {
+                    throw std::runtime_error(path + ": a list has the invalid length " + PlyNumberString(listLength)
+                                             + ".");
+                }
+                auto count = size_t(listLength);
+                const bool isIndices = isFace && (property.name == "vertex_indices" || property.name == "vertex_index");
+                face.clear();
+                for (size_t k = 0; k < count; k++)
+                {
+                    auto value = reader.Read(property.type);
+                    if (isIndices)
+                    {
+                        if (!IsPlyIndex(value, indexLimit))
+                        {
+                            throw std::runtime_error(path + ": a face refers to vertex " + PlyNumberString(value)
+                                                     + " of only " + std::to_string(vertexCount) + ".");
+                        }
+                        face.push_back(uint32_t(value));
+                    }
+                }
+                for (size_t k = 1; isIndices && k + 1 < face.size(); k++)
+                {
+                    indices.insert(indices.end(), {face[0], face[k], face[k + 1]});
+                }
+            }
+
+            if (isVertex)
+            {
+                vertices.push_back(position);
+            }
+        }
+    }
+    return TriangleMesh(std::move(vertices), std::move(indices), mat);
+}
+
+// Loads an OBJ or PLY mesh, told apart by the file extension.
+inline TriangleMesh LoadMesh(const std::string &path, MaterialId mat)
+{
+    auto extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+    { return char(std::tolower(c)); });
+
+    if (extension == ".obj")
+    {
+        return LoadObjMesh(path, mat);
+    }
+    if (extension == ".ply")
+    {
+        return LoadPlyMesh(path, mat);
+    }
+    throw std::runtime_error(path + " is neither an OBJ nor a PLY mesh.");
+}
+
+// Writes the positions and triangles of mesh as an OBJ file.
+inline void SaveObjMesh(const TriangleMesh &mesh, const std::string &path)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open " + path + " for writing.");
+    }
+
+    std::string out;
+    char digits[32];
+    for (const auto &v: mesh.Vertices())
+    {
+        out += 'v';
+        for (int axis = 0; axis < 3; axis++)
+        {
+            auto result = std::to_chars(digits, digits + sizeof(digits), v[axis]);
+            out += ' ';
+            out.append(digits, result.ptr);
+        }
+        out += '\n';
+    }
+
+    const auto &indices = mesh.Indices();
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        out += "f " + std::to_string(indices[i] + 1) + ' ' + std::to_string(indices[i + 1] + 1) + ' '
+               + std::to_string(indices[i + 2] + 1) + '\n';
+    }
+
+    file.write(out.data(), std::streamsize(out.size()));
+    if (!file)
+    {
+        throw std::runtime_error("Failed to write " + path + ".");
+    }
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#define RT_HAVE_PERF_EVENTS 1
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware events counted over a stretch of the program, summed over all its threads. A count is
+// empty when the kernel or the machine doesn't provide the event, as in many virtual machines and
+// containers, or when perf_event_paranoid forbids it.
+struct PerfCounts
+{
+    std::optional<uint64_t> instructions;
+    std::optional<uint64_t> cacheReferences;    // Last level cache accesses
+    std::optional<uint64_t> cacheMisses;        // Last level cache misses
+    std::optional<uint64_t> l1dMisses;          // Level 1 data cache read misses
+
+    bool Available() const
+    { return instructions || cacheReferences || cacheMisses || l1dMisses; }
+};
+
+// Counts hardware events with Linux perf events, from Start() to Stop(). Every thread that exists at
+// Start() gets counters of its own, which follow it into the threads it creates, so the render
+// threads are counted whether the pool is already running or started during the measurement. On
+// other systems every count stays empty.
+class PerfCounters
+{
+public:
+    PerfCounters() = default;
+
+    PerfCounters(const PerfCounters &) = delete;
+
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    ~PerfCounters()
+    { Close(); }
+
+    void Start()
+    {
+        Close();
+#ifdef RT_HAVE_PERF_EVENTS
+        constexpr uint64_t L1dReadMiss = PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8
+                                         | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+        const std::pair<uint32_t, uint64_t> events[EventCount] = {
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+                {PERF_TYPE_HW_CACHE, L1dReadMiss}
+        };
+
+        for (int thread: ThreadIds())
+        {
+            for (int e = 0; e < EventCount; e++)
+            {
+                perf_event_attr attr{};
+                attr.size = sizeof(attr);
+                attr.type = events[e].first;
+                attr.config = events[e].second;
+                attr.inherit = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+
+                int fd = int(syscall(SYS_perf_event_open, &attr, thread, -1, -1, 0));
+                if (fd >= 0)
+                {
+                    counters[e].push_back(fd);
+                }
+            }
+        }
+#endif
+    }
+
+    PerfCounts Stop()
+    {
+        PerfCounts counts;
+#ifdef RT_HAVE_PERF_EVENTS
+        std::optional<uint64_t> *results[EventCount] = {&counts.instructions, &counts.cacheReferences,
+                                                        &counts.cacheMisses, &counts.l1dMisses};
+        for (int e = 0; e < EventCount; e++)
+        {
+            for (int fd: counters[e])
+            {
+                uint64_t value = 0;
+                if (read(fd, &value, sizeof(value)) == sizeof(value))
+                {
+                    *results[e] = results[e]->value_or(0) + value;
+                }
+            }
+        }
+#endif
+        Close();
+        return counts;
+    }
+
+private:
+    static constexpr int EventCount = 4;
+
+    std::vector<int> counters[EventCount];  // One descriptor per event and thread
+
+    void Close()
+    {
+        for (auto &fds: counters)
+        {
+#ifdef RT_HAVE_PERF_EVENTS
+            for (int fd: fds)
+            {
+                close(fd);
+            }
+#endif
+            fds.clear();
+        }
+    }
+
+#ifdef RT_HAVE_PERF_EVENTS
+    static std::vector<int> ThreadIds()
+    {
+        std::vector<int> ids;
+        if (DIR *dir = opendir("/proc/self/task"))
+        {
+            while (dirent *entry = readdir(dir))
+            {
+                if (entry->d_name[0] != '.')
+                {
+                    ids.push_back(std::stoi(entry->d_name));
+                }
+            }
+            closedir(dir);
+        }
+        return ids;
+    }
+#endif
+};
+
+#endif
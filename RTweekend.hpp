@@ -2,12 +2,21 @@
 #define RTWEEKEND_H
 
 #include <cmath>
-#include <random>
+#include <cstdint>
 #include <iostream>
 #include <limits>
 #include <memory>
 #include <numbers>
 
+// Scalar type of the geometry and shading math. Compile with RT_USE_FLOAT for single precision, which
+// doubles the SIMD width and halves the memory traffic; the default double precision is the
+// reference.
+#ifdef RT_USE_FLOAT
+using Real = float;
+#else
+using Real = double;
+#endif
+
 // Constants
 #define RT_INFINITY std::numeric_limits<double>::infinity()
 #define PI std::numbers::pi
@@ -24,18 +33,76 @@ inline double DegreesToRadians(double degrees)
     return degrees * PI / 180.0;
 }
 
+// Permuted congruential generator (PCG32, https://www.pcg-random.org). Each generator owns a
+// small state and an independent stream, so threads never share or lock a generator.
+class Pcg32
+{
+public:
+    constexpr Pcg32()
+    { Seed(0, 0); }
+
+    constexpr Pcg32(uint64_t seed, uint64_t stream)
+    { Seed(seed, stream); }
+
+    constexpr void Seed(uint64_t seed, uint64_t stream)
+    {
+        state = 0;
+        inc = (stream << 1u) | 1u;
+        NextUInt();
+        state += seed;
+        NextUInt();
+    }
+
+    constexpr uint32_t NextUInt()
+    {
+        uint64_t oldState = state;
+        state = oldState * 6364136223846793005ULL + inc;
+        auto xorShifted = uint32_t(((oldState >> 18u) ^ oldState) >> 27u);
+        auto rot = uint32_t(oldState >> 59u);
+        return (xorShifted >> rot) | (xorShifted << ((-rot) & 31u));
+    }
+
+    constexpr double NextDouble()
+    {
+        // 32 random bits scaled into [0,1).
+        return NextUInt() * 0x1p-32;
+    }
+
+private:
+    uint64_t state = 0;
+    uint64_t inc = 1;
+};
+
+// Finalizer from SplitMix64; turns consecutive integers into well-distributed 64-bit seeds.
+constexpr uint64_t MixBits(uint64_t v)
+{
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ULL;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dULL;
+    v ^= v >> 33;
+    return v;
+}
+
+// Every thread draws from its own generator. Render threads reseed it per pixel, so the image only
+// depends on the seed and never on how pixels were distributed across threads.
+inline thread_local Pcg32 threadRng;
+
+inline void SeedRandom(uint64_t seed, uint64_t stream)
+{
+    threadRng.Seed(MixBits(seed ^ MixBits(stream)), stream);
+}
+
 inline double RandomDouble()
 {
-    static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-    static std::mt19937 generator;
-    return distribution(generator);
+    // Returns a random real in [0,1).
+    return threadRng.NextDouble();
 }
 
 inline double RandomDouble(double min, double max)
 {
-    static std::mt19937 generator;
-    std::uniform_real_distribution<double> distribution(min, max);
-    return distribution(generator);
+    // Returns a random real in [min,max).
+    return min + (max - min) * RandomDouble();
 }
 
 // Common Headers
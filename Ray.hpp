@@ -1,29 +1,37 @@
 #ifndef RAY_H
 #define RAY_H
 
-class Ray
+template<typename T>
+class RayT
 {
 public:
-    Ray()
+    RayT()
     {}
 
-    Ray(const Point3 &origin, const Vec3 &direction) : orig(origin), dir(direction)
+    RayT(const Vec3T<T> &origin, const Vec3T<T> &direction, T time = 0) : orig(origin), dir(direction), tm(time)
     {}
 
-    const Point3 &origin() const
+    const Vec3T<T> &origin() const
     { return orig; }
 
-    const Vec3 &direction() const
+    const Vec3T<T> &direction() const
     { return dir; }
 
-    Point3 at(double t) const
+    // Moment within the shutter interval the Ray samples, which places moving objects.
+    T time() const
+    { return tm; }
+
+    Vec3T<T> at(T t) const
     {
         return orig + t * dir;
     }
 
 private:
-    Point3 orig;
-    Vec3 dir;
+    Vec3T<T> orig;
+    Vec3T<T> dir;
+    T tm = 0;
 };
 
+using Ray = RayT<Real>;
+
 #endif
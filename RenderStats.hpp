@@ -0,0 +1,171 @@
+#ifndef RENDER_STATS_H
+#define RENDER_STATS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The detailed counters (sphere tests and hits, scatter calls, tile timings) sit in the innermost
+// loops. Build with RT_STATS=0 to compile them out; rays per depth and Russian roulette terminations
+// are counted either way, since the benchmark reports them.
+#ifndef RT_STATS
+#define RT_STATS 1
+#endif
+
+#if RT_STATS
+#define RT_STAT(...) __VA_ARGS__
+#else
+#define RT_STAT(...)
+#endif
+
+constexpr int MaxStatsDepth = 64;   // Deeper bounces are counted in the last bucket
+constexpr int StatsMaterialTypes = 3;
+
+// Names of the Material alternatives in variant order, for the scatter counts.
+inline const char *const statsMaterialNames[StatsMaterialTypes] = {"lambertian", "metal", "dielectric"};
+
+// Counters gathered while rendering. Every thread counts into its own threadStats without any
+// synchronization; Camera collects them once the threads have finished and merges them.
+struct RenderStats
+{
+    uint64_t raysPerDepth[MaxStatsDepth] = {};          // Rays traced at each bounce depth, 0 being camera rays
+    uint64_t rouletteTerminations = 0;                  // Paths ended by Russian roulette
+    uint64_t sphereTests = 0;                           // Ray-sphere intersection tests
+    uint64_t sphereHits = 0;                            // Tests that found a new closest hit
+    uint64_t triangleTests = 0;                         // Ray-triangle intersection tests
+    uint64_t triangleHits = 0;                          // Meshes hit, one per closest triangle found
+    uint64_t instanceTests = 0;                         // Rays transformed into an instance's mesh
+    uint64_t scatterCalls[StatsMaterialTypes] = {};     // Scatter calls per material type
+
+    void CountRay(int depth)
+    {
+        raysPerDepth[depth < MaxStatsDepth ? depth : MaxStatsDepth - 1]++;
+    }
+
+    uint64_t TotalRays() const
+    {
+        uint64_t total = 0;
+        for (auto count: raysPerDepth)
+        {
+            total += count;
+        }
+        return total;
+    }
+
+    uint64_t CameraRays() const
+    { return raysPerDepth[0]; }
+
+    uint64_t SecondaryRays() const
+    { return TotalRays() - CameraRays(); }
+
+    // Rays per path. Every path starts with one camera ray, so these are counted at depth 0.
+    double AveragePathLength() const
+    {
+        return raysPerDepth[0] > 0 ? double(TotalRays()) / double(raysPerDepth[0]) : 0;
+    }
+
+    void Merge(const RenderStats &other)
+    {
+        for (int d = 0; d < MaxStatsDepth; d++)
+        {
+            raysPerDepth[d] += other.raysPerDepth[d];
+        }
+        rouletteTerminations += other.rouletteTerminations;
+        sphereTests += other.sphereTests;
+        sphereHits += other.sphereHits;
+        triangleTests += other.triangleTests;
+        triangleHits += other.triangleHits;
+        instanceTests += other.instanceTests;
+        for (int m = 0; m < StatsMaterialTypes; m++)
+        {
+            scatterCalls[m] += other.scatterCalls[m];
+        }
+    }
+
+    void Print(std::ostream &out) const
+    {
+        out << "Rays: " << CameraRays() << " camera, " << SecondaryRays() << " secondary, "
+            << AveragePathLength() << " per path on average, " << rouletteTerminations
+            << " paths ended by Russian roulette\n";
+
+        out << "Rays per depth:";
+        for (int d = 0; d < MaxStatsDepth; d++)
+        {
+            if (raysPerDepth[d] > 0)
+            {
+                out << " " << d << ":" << raysPerDepth[d];
+            }
+        }
+        out << "\n";
+
+#if RT_STATS
+        out << "Sphere tests: " << sphereTests << ", hits: " << sphereHits << " ("
+            << (sphereTests > 0 ? 100.0 * double(sphereHits) / double(sphereTests) : 0) << "%)\n";
+        if (triangleTests > 0)
+        {
+            out << "Triangle tests: " << triangleTests << ", hits: " << triangleHits << " ("
+                << 100.0 * double(triangleHits) / double(triangleTests) << "%), instance tests: "
+                << instanceTests << "\n";
+        }
+
+        out << "Scatter calls:";
+        for (int m = 0; m < StatsMaterialTypes; m++)
+        {
+            out << " " << statsMaterialNames[m] << " " << scatterCalls[m];
+        }
+        out << "\n";
+#endif
+    }
+};
+
+inline thread_local RenderStats threadStats;
+
+// Wall-clock span of one rendered tile, in seconds since the start of the render.
+struct TileTiming
+{
+    int thread;
+    int x0, y0, x1, y1;
+    double start, end;
+
+    double Seconds() const
+    { return end - start; }
+};
+
+// Writes tile timings as a Chrome trace (the JSON event format read by chrome://tracing and
+// Perfetto), with one timeline row per render thread.
+inline void WriteChromeTrace(const std::vector<TileTiming> &timings, const std::string &path)
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        throw std::runtime_error("Failed to open " + path + " for writing.");
+    }
+
+    int threadCount = 0;
+    for (const auto &timing: timings)
+    {
+        threadCount = std::max(threadCount, timing.thread + 1);
+    }
+
+    out << "{\"traceEvents\": [\n";
+    for (int t = 0; t < threadCount; t++)
+    {
+        out << "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": " << t
+            << ", \"args\": {\"name\": \"Render thread " << t << "\"}},\n";
+    }
+    for (size_t k = 0; k < timings.size(); k++)
+    {
+        const auto &timing = timings[k];
+        out << "  {\"name\": \"Tile " << timing.x0 << "," << timing.y0 << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": "
+            << timing.thread << ", \"ts\": " << timing.start * 1e6 << ", \"dur\": " << timing.Seconds() * 1e6
+            << ", \"args\": {\"x1\": " << timing.x1 << ", \"y1\": " << timing.y1 << "}}"
+            << (k + 1 < timings.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+}
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "RTweekend.hpp"
+
+#include <algorithm>
+#include <concepts>
+
+// Samplers hand out the uniform numbers of one pixel sample, one dimension at a time. Camera starts
+// every pixel sample with StartPixelSample() and moves to fixed dimensions for the pixel position,
+// the lens and each bounce with SetDimension(), so a dimension always means the same thing across
+// samples and can be stratified. All values depend only on the seed, pixel, sample index and
+// dimension, never on what was drawn before, so paths can be resumed from any bounce.
+//
+// The samplers are plain values selected per tile (see Camera::SamplerType); the concept replaces
+// a virtual interface, so Get1D() and Get2D() inline into the integrator.
+
+struct Sample2D
+{
+    Real x, y;
+};
+
+template<typename S>
+concept Sampler = requires(S sampler, uint64_t pixel, uint32_t sample, int dimension)
+{
+    sampler.StartPixelSample(pixel, sample);
+    sampler.SetDimension(dimension);
+    { sampler.Get1D() } -> std::same_as<Real>;
+    { sampler.Get2D() } -> std::same_as<Sample2D>;
+};
+
+// Largest Real below one. Samples are clamped to it, since 32 random bits can round up to 1 in float.
+constexpr Real OneMinusEpsilon = 1 - std::numeric_limits<Real>::epsilon() / 2;
+
+inline Real UIntToUnit(uint32_t bits)
+{
+    return std::min(Real(bits * 0x1p-32), OneMinusEpsilon);
+}
+
+inline uint32_t ReverseBits(uint32_t v)
+{
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0f0f0f0fu) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v >> 8) & 0x00ff00ffu) | ((v & 0x00ff00ffu) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+// Element i of a random permutation of [0, length) picked by seed, without storing the permutation
+// (Kensler, "Correlated Multi-Jittered Sampling").
+inline uint32_t PermutationElement(uint32_t i, uint32_t length, uint32_t seed)
+{
+    uint32_t w = length - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do
+    {
+        i ^= seed;
+        i *= 0xe170893d;
+        i ^= seed >> 16;
+        i ^= (i & w) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3f;
+        i ^= seed >> 23;
+        i ^= (i & w) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69;
+        i ^= (i & w) >> 11;
+        i *= 0x74dcb303;
+        i ^= (i & w) >> 2;
+        i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;
+        i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= length);
+    return (i + seed) % length;
+}
+
+// Owen scrambling of a 32-bit fixed point number by hashing (Burley, "Practical Hash-based Owen
+// Scrambling"). Every bit is flipped depending only on the bits above it, so stratification of the
+// input is kept.
+inline uint32_t NestedUniformScramble(uint32_t x, uint32_t seed)
+{
+    x = ReverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return ReverseBits(x);
+}
+
+// Generator matrices of the first two Sobol dimensions: the van der Corput sequence and the one
+// for the polynomial x + 1. Together they form a (0,2)-sequence.
+struct SobolMatrices
+{
+    uint32_t columns[2][32];
+};
+
+constexpr SobolMatrices MakeSobolMatrices()
+{
+    SobolMatrices matrices{};
+    uint32_t v = 1u << 31;
+    for (int bit = 0; bit < 32; bit++)
+    {
+        matrices.columns[0][bit] = 1u << (31 - bit);
+        matrices.columns[1][bit] = v;
+        v ^= v >> 1;
+    }
+    return matrices;
+}
+
+inline constexpr SobolMatrices sobolMatrices = MakeSobolMatrices();
+
+inline uint32_t SobolSample(uint32_t index, int dimension)
+{
+    uint32_t x = 0;
+    for (int bit = 0; index != 0; bit++, index >>= 1)
+    {
+        if (index & 1)
+        {
+            x ^= sobolMatrices.columns[dimension][bit];
+        }
+    }
+    return x;
+}
+
+// Independent uniform numbers from a PCG32 stream per pixel sample and dimension.
+class IndependentSampler
+{
+public:
+    IndependentSampler(uint64_t seed, [[maybe_unused]] int samplesPerPixel) : seed(seed)
+    {}
+
+    void StartPixelSample(uint64_t pixel, uint32_t sample)
+    {
+        this->pixel = pixel;
+        sampleSeed = MixBits(MixBits(seed ^ MixBits(pixel)) + sample);
+        SetDimension(0);
+    }
+
+    void SetDimension(int dimension)
+    {
+        rng.Seed(MixBits(sampleSeed + uint64_t(dimension)), pixel);
+    }
+
+    Real Get1D()
+    {
+        return UIntToUnit(rng.NextUInt());
+    }
+
+    Sample2D Get2D()
+    {
+        auto x = Get1D();
+        return {x, Get1D()};
+    }
+
+private:
+    uint64_t seed;
+    uint64_t pixel = 0;
+    uint64_t sampleSeed = 0;
+    Pcg32 rng;
+};
+
+// Every dimension is split into samplesPerPixel strata, and the samples of a pixel visit the strata
+// in an order shuffled per dimension, with a random offset inside each stratum (Latin hypercube
+// sampling). Sample indices past samplesPerPixel start a new, independently shuffled round.
+class StratifiedSampler
+{
+public:
+    StratifiedSampler(uint64_t seed, int samplesPerPixel) : seed(seed), strata(uint32_t(std::max(1, samplesPerPixel)))
+    {}
+
+    void StartPixelSample(uint64_t pixel, uint32_t sample)
+    {
+        pixelSeed = MixBits(MixBits(seed ^ MixBits(pixel)) + sample / strata);
+        this->sample = sample;
+        dimension = 0;
+    }
+
+    void SetDimension(int dimension)
+    {
+        this->dimension = dimension;
+    }
+
+    Real Get1D()
+    {
+        uint64_t hash = MixBits(pixelSeed + uint64_t(dimension++));
+        uint32_t stratum = PermutationElement(sample % strata, strata, uint32_t(hash));
+        Real jitter = UIntToUnit(uint32_t(MixBits(hash + sample)));
+        return std::min((stratum + jitter) / strata, OneMinusEpsilon);
+    }
+
+    Sample2D Get2D()
+    {
+        auto x = Get1D();
+        return {x, Get1D()};
+    }
+
+private:
+    uint64_t seed;
+    uint32_t strata;
+    uint64_t pixelSeed = 0;
+    uint32_t sample = 0;
+    int dimension = 0;
+};
+
+// Owen scrambled Sobol points. Every 2D request is a separately scrambled (0,2)-sequence over the
+// sample index, and the index itself is shuffled per dimension pair so the pairs are decorrelated
+// from each other (Burley's shuffled scrambled Sobol). Any power of two prefix of the samples of a
+// pixel is well stratified in each pair, which is what lets progressive and adaptive rendering stop
+// at any count.
+class SobolSampler
+{
+public:
+    SobolSampler(uint64_t seed, [[maybe_unused]] int samplesPerPixel) : seed(seed)
+    {}
+
+    void StartPixelSample(uint64_t pixel, uint32_t sample)
+    {
+        pixelSeed = MixBits(seed ^ MixBits(pixel));
+        this->sample = sample;
+        dimension = 0;
+    }
+
+    void SetDimension(int dimension)
+    {
+        this->dimension = dimension;
+    }
+
+    Real Get1D()
+    {
+        uint64_t hash = MixBits(pixelSeed + uint64_t(dimension++));
+        uint32_t index = NestedUniformScramble(sample, uint32_t(hash));
+        return UIntToUnit(NestedUniformScramble(SobolSample(index, 0), uint32_t(hash >> 32)));
+    }
+
+    Sample2D Get2D()
+    {
+        uint64_t hash = MixBits(pixelSeed + uint64_t(dimension));
+        dimension += 2;
+        uint32_t index = NestedUniformScramble(sample, uint32_t(hash));
+        uint64_t scrambleSeed = MixBits(hash);
+        return {UIntToUnit(NestedUniformScramble(SobolSample(index, 0), uint32_t(hash >> 32))),
+                UIntToUnit(NestedUniformScramble(SobolSample(index, 1), uint32_t(scrambleSeed)))};
+    }
+
+private:
+    uint64_t seed;
+    uint64_t pixelSeed = 0;
+    uint32_t sample = 0;
+    int dimension = 0;
+};
+
+#endif
@@ -0,0 +1,639 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include "RTweekend.hpp"
+#include "Camera.hpp"
+#include "Material.hpp"
+#include "SphereSet.hpp"
+#include "Scenes.hpp"
+#include "MappedFile.hpp"
+#include "SceneTokenizer.hpp"
+#include "MeshFile.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Scenes are stored in one of two encodings.
+//
+// The text encoding is for authoring. It has one statement per line, and '#' starts a comment:
+//
+//     camera look_from 13 2 3             # Any Camera setting, see ApplyCameraSetting()
+//     material ground lambertian 0.5 0.5 0.5
+//     material steel metal 0.7 0.6 0.5 0.1     # Albedo, then fuzz
+//     material glass dielectric 1.5            # Refraction index
+//     sphere 0 -1000 0 1000 ground             # Center, radius and material name
+//     moving_sphere 1 0.2 2 1 0.5 2 0.2 steel  # Center at time 0, center at time 1, radius, material
+//     mesh bunny.obj glass                     # OBJ or PLY file, relative to the scene file, and material
+//     geometry rock rock.ply stone             # Loads a mesh to place with instance statements
+//     instance rock scale 2 2 2 rotate_y 30 translate 5 0 1 material granite
+//
+// An instance places a geometry with transforms applied in the order written: translate x y z,
+// scale x y z, rotate_x/rotate_y/rotate_z degrees, and matrix with the 12 values of a Transform row by
+// row. An optional material replaces the geometry's.
+//
+// The binary encoding is for generated scenes. It is a SceneFileHeader, materialCount
+// SceneFileMaterial records, and then the spheres in the layout SphereSet keeps them in: sphereCount
+// doubles each for x, y, z and radius, followed by sphereCount uint32 material indices. Numbers are
+// stored in the native byte order of the machine that saved the file, with no conversion either way,
+// so files only load correctly on machines of the same byte order; use the text encoding to move
+// scenes between others. The loader maps the file and appends the arrays to the SphereSet in one go.
+// Scenes with moving spheres set SceneFileHasMotion in the header flags; a SceneFileMotion record
+// then follows the header, and sphereCount doubles each for the x, y and z motion follow the radii.
+// Triangle meshes have no binary encoding; scenes with meshes are saved as text, with every mesh
+// written to an OBJ file next to the scene and placed by instance statements.
+
+constexpr char SceneFileMagic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '1'};
+constexpr uint32_t SceneFileHasMotion = 1;
+
+struct SceneFileHeader
+{
+    char magic[8];
+    uint32_t materialCount;
+    uint32_t flags;
+    uint64_t sphereCount;
+
+    double aspectRatio;
+    double vFov;
+    double lookFrom[3];
+    double lookAt[3];
+    double vUp[3];
+    double defocusAngle;
+    double focusDist;
+    int32_t imageWidth;
+    int32_t samplesPerPixel;
+    int32_t maxDepth;
+    int32_t padding;
+};
+
+struct SceneFileMaterial
+{
+    uint32_t type;          // Index of the alternative in Material
+    uint32_t reserved;
+    double values[4];       // Albedo and fuzz for Metal, albedo for Lambertian, refraction index for Dielectric
+};
+
+struct SceneFileMotion
+{
+    double shutterOpen;
+    double shutterClose;
+};
+
+// Keeps the sphere arrays 8-byte aligned inside the file, so they can be used in place.
+static_assert(sizeof(SceneFileHeader) % 8 == 0 && sizeof(SceneFileMaterial) % 8 == 0 &&
+              sizeof(SceneFileMotion) % 8 == 0);
+
+// Reads a shutter time, which has to lie in [0, 1] where moving spheres are placed.
+inline double ShutterTime(SceneTokenizer &tokens)
+{
+    double time = tokens.Number();
+    if (!(0 <= time && time <= 1))
+    {
+        tokens.Fail("shutter times must lie in [0, 1]");
+    }
+    return time;
+}
+
+// Reads a camera setting that counts something and has to be at least one, such as the image width.
+inline int PositiveInteger(SceneTokenizer &tokens, std::string_view name)
+{
+    int value = tokens.Integer();
+    if (value <= 0)
+    {
+        tokens.Fail(std::string(name) + " must be positive");
+    }
+    return value;
+}
+
+// Reads the value of one "camera <name> <value>" statement into cam.
+inline void ApplyCameraSetting(Camera &cam, std::string_view name, SceneTokenizer &tokens)
+{
+    if (name == "aspect_ratio") cam.aspectRatio = tokens.Number();
+    else if (name == "width") cam.imageWidth = PositiveInteger(tokens, name);
+    else if (name == "samples") cam.samplesPerPixel = PositiveInteger(tokens, name);
+    else if (name == "max_depth") cam.maxDepth = PositiveInteger(tokens, name);
+    else if (name == "vfov") cam.vFov = tokens.Number();
+    else if (name == "look_from") cam.lookFrom = tokens.Vector();
+    else if (name == "look_at") cam.lookAt = tokens.Vector();
+    else if (name == "up") cam.vUp = tokens.Vector();
+    else if (name == "defocus_angle") cam.defocusAngle = tokens.Number();
+    else if (name == "focus_distance") cam.focusDist = tokens.Number();
+    else if (name == "shutter_open") cam.shutterOpen = ShutterTime(tokens);
+    else if (name == "shutter_close") cam.shutterClose = ShutterTime(tokens);
+    else tokens.Fail("unknown camera setting '" + std::string(name) + "'");
+}
+
+inline Scene LoadTextScene(const MappedFile &file, const std::string &path)
+{
+    // Heterogeneous lookup, so finding a material by name doesn't allocate a string per sphere.
+    struct NameHash
+    {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view name) const
+        { return std::hash<std::string_view>()(name); }
+    };
+    std::unordered_map<std::string, MaterialId, NameHash, std::equal_to<>> materialIds;
+
+    std::unordered_map<std::string, uint32_t, NameHash, std::equal_to<>> geometryIds;
+
+    Scene scene;
+    scene.camera = std::make_unique<Camera>();
+
+    SceneTokenizer tokens(file.Data(), file.Data() + file.Size(), path);
+    auto materialNamed = [&](std::string_view name)
+    {
+        auto found = materialIds.find(name);
+        if (found == materialIds.end())
+        {
+            tokens.Fail("unknown material '" + std::string(name) + "'");
+        }
+        return found->second;
+    };
+    while (tokens.NextLine())
+    {
+        auto statement = tokens.Word();
+        if (statement == "sphere")
+        {
+            auto center = tokens.Vector();
+            auto radius = tokens.Number();
+            auto mat = materialNamed(tokens.Word());
+            scene.world.Add(center, radius, mat);
+        }
+        else if (statement == "moving_sphere")
+        {
+            auto center0 = tokens.Vector();
+            auto center1 = tokens.Vector();
+            auto radius = tokens.Number();
+            auto mat = materialNamed(tokens.Word());
+            scene.world.AddMoving(center0, center1, radius, mat);
+        }
+        else if (statement == "mesh" || statement == "geometry")
+        {
+            auto name = statement == "geometry" ? tokens.Word() : std::string_view();
+            auto meshPath = std::filesystem::path(path).parent_path() / std::filesystem::path(tokens.Word());
+            auto mesh = LoadMesh(meshPath.string(), materialNamed(tokens.Word()));
+
+            if (statement == "mesh")
+            {
+                scene.AddMesh(std::move(mesh));
+            }
+            else if (!geometryIds.emplace(name, scene.instances.AddMesh(std::move(mesh))).second)
+            {
+                tokens.Fail("geometry '" + std::string(name) + "' is defined twice");
+            }
+        }
+        else if (statement == "instance")
+        {
+            auto name = tokens.Word();
+            auto found = geometryIds.find(name);
+            if (found == geometryIds.end())
+            {
+                tokens.Fail("unknown geometry '" + std::string(name) + "'");
+            }
+
+            // Transforms apply to the mesh in the order they are written.
+            Transform objectToWorld;
+            MaterialId mat = InheritMaterial;
+            while (!tokens.AtLineEnd())
+            {
+                auto operation = tokens.Word();
+                if (operation == "translate") objectToWorld = Transform::Translate(tokens.Vector()) * objectToWorld;
+                else if (operation == "scale")
+                {
+                    auto factors = tokens.Vector();
+                    objectToWorld = Transform::Scale(factors.X(), factors.Y(), factors.Z()) * objectToWorld;
+                }
+                else if (operation == "rotate_x") objectToWorld = Transform::Rotate(0, tokens.Number()) * objectToWorld;
+                else if (operation == "rotate_y") objectToWorld = Transform::Rotate(1, tokens.Number()) * objectToWorld;
+                else if (operation == "rotate_z") objectToWorld = Transform::Rotate(2, tokens.Number()) * objectToWorld;
+                else if (operation == "matrix")
+                {
+                    Transform matrix;
+                    for (auto &row: matrix.m)
+                    {
+                        for (auto &value: row)
+                        {
+                            value = Real(tokens.Number());
+                        }
+                    }
+                    objectToWorld = matrix * objectToWorld;
+                }
+                else if (operation == "material") mat = materialNamed(tokens.Word());
+                else tokens.Fail("unknown instance setting '" + std::string(operation) + "'");
+            }
+
+            try
+            {
+                scene.instances.AddInstance(found->second, objectToWorld, mat);
+            }
+            catch (const std::exception &e)
+            {
+                tokens.Fail(e.what());
+            }
+        }
+        else if (statement == "material")
+        {
+            auto name = tokens.Word();
+            auto type = tokens.Word();
+
+            MaterialId id;
+            if (type == "lambertian")
+            {
+                id = scene.materials.Add(Lambertian(tokens.Vector()));
+            }
+            else if (type == "metal")
+            {
+                auto albedo = tokens.Vector();
+                id = scene.materials.Add(Metal(albedo, tokens.Number()));
+            }
+            else if (type == "dielectric")
+            {
+                id = scene.materials.Add(Dielectric(tokens.Number()));
+            }
+            else
+            {
+                tokens.Fail("unknown material type '" + std::string(type) + "'");
+            }
+
+            if (!materialIds.emplace(name, id).second)
+            {
+                tokens.Fail("material '" + std::string(name) + "' is defined twice");
+            }
+        }
+        else if (statement == "camera")
+        {
+            ApplyCameraSetting(*scene.camera, tokens.Word(), tokens);
+        }
+        else
+        {
+            tokens.Fail("unknown statement '" + std::string(statement) + "'");
+        }
+        tokens.EndLine();
+    }
+
+    return scene;
+}
+
+inline Scene LoadBinaryScene(const MappedFile &file, const std::string &path)
+{
+    constexpr size_t BytesPerSphere = 4 * sizeof(double) + sizeof(MaterialId);
+    constexpr size_t BytesPerMotion = 3 * sizeof(double);
+
+    SceneFileHeader header;
+    if (file.Size() < sizeof(header))
+    {
+        throw std::runtime_error(path + " is truncated.");
+    }
+    std::memcpy(&header, file.Data(), sizeof(header));
+
+    const bool hasMotion = (header.flags & SceneFileHasMotion) != 0;
+    size_t motionBytes = hasMotion ? sizeof(SceneFileMotion) : 0;
+    size_t materialBytes = size_t(header.materialCount) * sizeof(SceneFileMaterial);
+    size_t sphereBytes = hasMotion ? BytesPerSphere + BytesPerMotion : BytesPerSphere;
+    if (header.sphereCount > file.Size() / sphereBytes ||
+        file.Size() != sizeof(header) + motionBytes + materialBytes + header.sphereCount * sphereBytes)
+    {
+        throw std::runtime_error(path + " does not match the sizes in its header.");
+    }
+    if (header.imageWidth <= 0 || header.samplesPerPixel <= 0 || header.maxDepth <= 0)
+    {
+        throw std::runtime_error(path + ": the image width, samples and maximum depth must be positive.");
+    }
+
+    Scene scene;
+    scene.camera = std::make_unique<Camera>();
+    auto &cam = *scene.camera;
+    cam.aspectRatio = header.aspectRatio;
+    cam.imageWidth = header.imageWidth;
+    cam.samplesPerPixel = header.samplesPerPixel;
+    cam.maxDepth = header.maxDepth;
+    cam.vFov = header.vFov;
+    cam.lookFrom = Point3(header.lookFrom[0], header.lookFrom[1], header.lookFrom[2]);
+    cam.lookAt = Point3(header.lookAt[0], header.lookAt[1], header.lookAt[2]);
+    cam.vUp = Vec3(header.vUp[0], header.vUp[1], header.vUp[2]);
+    cam.defocusAngle = header.defocusAngle;
+    cam.focusDist = header.focusDist;
+
+    const char *data = file.Data() + sizeof(header);
+    if (hasMotion)
+    {
+        SceneFileMotion motion;
+        std::memcpy(&motion, data, sizeof(motion));
+        if (!(0 <= motion.shutterOpen && motion.shutterOpen <= 1 && 0 <= motion.shutterClose
+              && motion.shutterClose <= 1))
+        {
+            throw std::runtime_error(path + ": the shutter times must lie in [0, 1].");
+        }
+        cam.shutterOpen = motion.shutterOpen;
+        cam.shutterClose = motion.shutterClose;
+        data += sizeof(motion);
+    }
+
+    for (uint32_t m = 0; m < header.materialCount; m++)
+    {
+        SceneFileMaterial record;
+        std::memcpy(&record, data + m * sizeof(record), sizeof(record));
+
+        const double *v = record.values;
+        switch (record.type)
+        {
+            case 0:
+                scene.materials.Add(Lambertian(Color(v[0], v[1], v[2])));
+                break;
+            case 1:
+                scene.materials.Add(Metal(Color(v[0], v[1], v[2]), v[3]));
+                break;
+            case 2:
+                scene.materials.Add(Dielectric(v[0]));
+                break;
+            default:
+                throw std::runtime_error(path + ": material " + std::to_string(m) + " has an unknown type.");
+        }
+    }
+
+    size_t count = header.sphereCount;
+    auto spheres = reinterpret_cast<const double *>(data + materialBytes);
+    auto motion = hasMotion ? spheres + 4 * count : nullptr;
+    auto sphereMaterials = reinterpret_cast<const MaterialId *>(spheres + (hasMotion ? 7 : 4) * count);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (sphereMaterials[i] >= header.materialCount)
+        {
+            throw std::runtime_error(path + ": sphere " + std::to_string(i) + " refers to a missing material.");
+        }
+    }
+
+    scene.world.Reserve(count);
+    if (hasMotion)
+    {
+        scene.world.Append(spheres, spheres + count, spheres + 2 * count, spheres + 3 * count, sphereMaterials, count,
+                           motion, motion + count, motion + 2 * count);
+    }
+    else
+    {
+        scene.world.Append(spheres, spheres + count, spheres + 2 * count, spheres + 3 * count, sphereMaterials,
+                           count);
+    }
+    return scene;
+}
+
+// Loads a scene in either encoding, told apart by the magic at the start of binary files.
+inline Scene LoadScene(const std::string &path)
+{
+    MappedFile file(path);
+    if (file.Size() >= sizeof(SceneFileMagic) &&
+        std::memcmp(file.Data(), SceneFileMagic, sizeof(SceneFileMagic)) == 0)
+    {
+        return LoadBinaryScene(file, path);
+    }
+    return LoadTextScene(file, path);
+}
+
+// Appends the shortest text that reads back as exactly value.
+inline void AppendNumber(std::string &out, double value)
+{
+    char digits[32];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out += ' ';
+    out.append(digits, result.ptr);
+}
+
+inline void AppendVector(std::string &out, const Vec3 &v)
+{
+    AppendNumber(out, v.X());
+    AppendNumber(out, v.Y());
+    AppendNumber(out, v.Z());
+}
+
+inline void SaveTextScene(const Scene &scene, const std::string &path)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open " + path + " for writing.");
+    }
+
+    const auto &cam = *scene.camera;
+    std::string out = "# inOneWeekend scene\n";
+    out += "camera aspect_ratio";
+    AppendNumber(out, cam.aspectRatio);
+    out += "\ncamera width " + std::to_string(cam.imageWidth);
+    out += "\ncamera samples " + std::to_string(cam.samplesPerPixel);
+    out += "\ncamera max_depth " + std::to_string(cam.maxDepth);
+    out += "\ncamera vfov";
+    AppendNumber(out, cam.vFov);
+    out += "\ncamera look_from";
+    AppendVector(out, cam.lookFrom);
+    out += "\ncamera look_at";
+    AppendVector(out, cam.lookAt);
+    out += "\ncamera up";
+    AppendVector(out, cam.vUp);
+    out += "\ncamera defocus_angle";
+    AppendNumber(out, cam.defocusAngle);
+    out += "\ncamera focus_distance";
+    AppendNumber(out, cam.focusDist);
+    out += "\ncamera shutter_open";
+    AppendNumber(out, cam.shutterOpen);
+    out += "\ncamera shutter_close";
+    AppendNumber(out, cam.shutterClose);
+    out += "\n\n";
+
+    for (size_t m = 0; m < scene.materials.Size(); m++)
+    {
+        const auto &mat = scene.materials[MaterialId(m)];
+        out += "material m" + std::to_string(m);
+        switch (mat.index())
+        {
+            case 0:
+                out += " lambertian";
+                AppendVector(out, std::get_if<0>(&mat)->Albedo());
+                break;
+            case 1:
+                out += " metal";
+                AppendVector(out, std::get_if<1>(&mat)->Albedo());
+                AppendNumber(out, std::get_if<1>(&mat)->Fuzz());
+                break;
+            case 2:
+                out += " dielectric";
+                AppendNumber(out, std::get_if<2>(&mat)->RefractionIndex());
+                break;
+        }
+        out += '\n';
+    }
+    out += '\n';
+
+    for (size_t i = 0; i < scene.world.Size(); i++)
+    {
+        auto motion = scene.world.Motion(i);
+        if (motion.LengthSquared() > 0)
+        {
+            out += "moving_sphere";
+            AppendVector(out, scene.world.Center(i));
+            AppendVector(out, scene.world.Center(i) + motion);
+        }
+        else
+        {
+            out += "sphere";
+            AppendVector(out, scene.world.Center(i));
+        }
+        AppendNumber(out, scene.world.Radius(i));
+        out += " m" + std::to_string(scene.world.MaterialOf(i)) + '\n';
+
+        // Write in chunks, so huge scenes don't build their whole text in memory.
+        if (out.size() > (1 << 20))
+        {
+            file.write(out.data(), std::streamsize(out.size()));
+            out.clear();
+        }
+    }
+
+    const auto &instances = scene.instances;
+    auto stem = std::filesystem::path(path).stem().string();
+    for (size_t k = 0; k < instances.MeshCount(); k++)
+    {
+        auto meshName = stem + "_mesh" + std::to_string(k) + ".obj";
+        SaveObjMesh(instances.Mesh(k), (std::filesystem::path(path).parent_path() / meshName).string());
+        out += "geometry g" + std::to_string(k) + " " + meshName + " m"
+               + std::to_string(instances.Mesh(k).MeshMaterial()) + '\n';
+    }
+
+    for (size_t i = 0; i < instances.InstanceCount(); i++)
+    {
+        const auto &instance = instances.Instance(i);
+        out += "instance g" + std::to_string(instance.mesh) + " matrix";
+        for (const auto &row: instance.worldToObject.Inverse().m)
+        {
+            for (auto value: row)
+            {
+                AppendNumber(out, value);
+            }
+        }
+        if (instance.material != InheritMaterial)
+        {
+            out += " material m" + std::to_string(instance.material);
+        }
+        out += '\n';
+
+        if (out.size() > (1 << 20))
+        {
+            file.write(out.data(), std::streamsize(out.size()));
+            out.clear();
+        }
+    }
+    file.write(out.data(), std::streamsize(out.size()));
+}
+
+inline void SaveBinaryScene(const Scene &scene, const std::string &path)
+{
+    if (scene.instances.InstanceCount() > 0)
+    {
+        throw std::runtime_error("Binary scene files can't hold triangle meshes; save " + path + " as text.");
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Failed to open " + path + " for writing.");
+    }
+
+    const auto &cam = *scene.camera;
+    SceneFileHeader header{};
+    std::memcpy(header.magic, SceneFileMagic, sizeof(SceneFileMagic));
+    header.materialCount = uint32_t(scene.materials.Size());
+    header.sphereCount = scene.world.Size();
+    header.aspectRatio = cam.aspectRatio;
+    header.vFov = cam.vFov;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        header.lookFrom[axis] = cam.lookFrom[axis];
+        header.lookAt[axis] = cam.lookAt[axis];
+        header.vUp[axis] = cam.vUp[axis];
+    }
+    header.defocusAngle = cam.defocusAngle;
+    header.focusDist = cam.focusDist;
+    header.imageWidth = cam.imageWidth;
+    header.samplesPerPixel = cam.samplesPerPixel;
+    header.maxDepth = cam.maxDepth;
+    header.flags = scene.world.HasMotion() ? SceneFileHasMotion : 0;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    if (scene.world.HasMotion())
+    {
+        SceneFileMotion motion{cam.shutterOpen, cam.shutterClose};
+        file.write(reinterpret_cast<const char *>(&motion), sizeof(motion));
+    }
+
+    for (size_t m = 0; m < scene.materials.Size(); m++)
+    {
+        const auto &mat = scene.materials[MaterialId(m)];
+        SceneFileMaterial record{};
+        record.type = uint32_t(mat.index());
+        switch (mat.index())
+        {
+            case 0:
+            {
+                const auto &albedo = std::get_if<0>(&mat)->Albedo();
+                record.values[0] = albedo.X();
+                record.values[1] = albedo.Y();
+                record.values[2] = albedo.Z();
+                break;
+            }
+            case 1:
+            {
+                const auto &albedo = std::get_if<1>(&mat)->Albedo();
+                record.values[0] = albedo.X();
+                record.values[1] = albedo.Y();
+                record.values[2] = albedo.Z();
+                record.values[3] = std::get_if<1>(&mat)->Fuzz();
+                break;
+            }
+            case 2:
+                record.values[0] = std::get_if<2>(&mat)->RefractionIndex();
+                break;
+        }
+        file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    }
+
+    const auto &world = scene.world;
+    std::vector<double> values(world.Size());
+    const int columns = world.HasMotion() ? 7 : 4;
+    for (int column = 0; column < columns; column++)
+    {
+        for (size_t i = 0; i < world.Size(); i++)
+        {
+            values[i] = column < 3 ? world.Center(i)[column]
+                                   : column == 3 ? world.Radius(i) : world.Motion(i)[column - 4];
+        }
+        file.write(reinterpret_cast<const char *>(values.data()), std::streamsize(values.size() * sizeof(double)));
+    }
+
+    std::vector<MaterialId> sphereMaterials(world.Size());
+    for (size_t i = 0; i < world.Size(); i++)
+    {
+        sphereMaterials[i] = world.MaterialOf(i);
+    }
+    file.write(reinterpret_cast<const char *>(sphereMaterials.data()),
+               std::streamsize(sphereMaterials.size() * sizeof(MaterialId)));
+}
+
+// Saves in the binary encoding when the file name ends in .rtscene, otherwise as text.
+inline void SaveScene(const Scene &scene, const std::string &path)
+{
+    if (std::filesystem::path(path).extension() == ".rtscene")
+    {
+        SaveBinaryScene(scene, path);
+    }
+    else
+    {
+        SaveTextScene(scene, path);
+    }
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef SCENE_TOKENIZER_H
+#define SCENE_TOKENIZER_H
+
+#include "RTweekend.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Splits text files (scene, camera path and OBJ files) into whitespace separated words, one line at a
+// time. '#' starts a comment that runs to the end of the line.
+class SceneTokenizer
+{
+public:
+    SceneTokenizer(const char *begin, const char *end, const std::string &path) : next(begin), end(end), path(path)
+    {}
+
+    // Moves to the next line that has a statement on it. Returns false at the end of the file.
+    bool NextLine()
+    {
+        while (next < end)
+        {
+            pos = next;
+            auto newline = static_cast<const char *>(std::memchr(pos, '\n', size_t(end - pos)));
+            lineEnd = newline != nullptr ? newline : end;
+            next = newline != nullptr ? newline + 1 : end;
+            line++;
+
+            auto comment = static_cast<const char *>(std::memchr(pos, '#', size_t(lineEnd - pos)));
+            if (comment != nullptr)
+            {
+                lineEnd = comment;
+            }
+
+            SkipSpace();
+            if (pos < lineEnd)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string_view Word()
+    {
+        SkipSpace();
+        if (pos >= lineEnd)
+        {
+            Fail("unexpected end of line");
+        }
+
+        auto start = pos;
+        while (pos < lineEnd && !IsSpace(*pos))
+        {
+            pos++;
+        }
+        return {start, size_t(pos - start)};
+    }
+
+    double Number()
+    {
+        auto word = Word();
+        double value;
+        auto [ptr, ec] = std::from_chars(word.data(), word.data() + word.size(), value);
+        if (ec != std::errc() || ptr != word.data() + word.size())
+        {
+            Fail("expected a number instead of '" + std::string(word) + "'");
+        }
+        return value;
+    }
+
+    int Integer()
+    {
+        auto word = Word();
+        int value;
+        auto [ptr, ec] = std::from_chars(word.data(), word.data() + word.size(), value);
+        if (ec != std::errc() || ptr != word.data() + word.size())
+        {
+            Fail("expected an integer instead of '" + std::string(word) + "'");
+        }
+        return value;
+    }
+
+    Vec3 Vector()
+    {
+        auto x = Number();
+        auto y = Number();
+        auto z = Number();
+        return Vec3(x, y, z);
+    }
+
+    // Whether the current line has no more words.
+    bool AtLineEnd()
+    {
+        SkipSpace();
+        return pos >= lineEnd;
+    }
+
+    // Fails if anything but a comment follows the statement.
+    void EndLine()
+    {
+        SkipSpace();
+        if (pos < lineEnd)
+        {
+            Fail("unexpected '" + std::string(Word()) + "'");
+        }
+    }
+
+    [[noreturn]] void Fail(const std::string &message) const
+    {
+        throw std::runtime_error(path + ":" + std::to_string(line) + ": " + message + ".");
+    }
+
+private:
+    const char *pos = nullptr;
+    const char *lineEnd = nullptr;
+    const char *next;
+    const char *end;
+    int line = 0;
+    std::string path;
+
+    static bool IsSpace(char c)
+    { return c == ' ' || c == '\t' || c == '\r'; }
+
+    void SkipSpace()
+    {
+        while (pos < lineEnd && IsSpace(*pos))
+        {
+            pos++;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,448 @@
+#ifndef SCENES_H
+#define SCENES_H
+
+#include "RTweekend.hpp"
+#include "Camera.hpp"
+#include "Material.hpp"
+#include "SphereSet.hpp"
+#include "TriangleMesh.hpp"
+#include "InstanceSet.hpp"
+#include "Arena.hpp"
+
+#include <bit>
+#include <memory>
+#include <vector>
+
+// A world of spheres and instanced triangle meshes with its materials and the Camera set up to look at
+// it. The Scene is the HitTable the Camera renders: it tests the spheres and the instances, each
+// against their own hierarchy. Scenes are generated from a fixed random sequence, so the same function
+// always builds the same scene.
+struct Scene : public HitTable
+{
+    MaterialTable materials;
+    SphereSet world;
+    InstanceSet instances;
+    std::unique_ptr<Camera> camera;
+
+    // Adds mesh and places it once, where its vertices are.
+    void AddMesh(TriangleMesh mesh)
+    {
+        instances.AddInstance(instances.AddMesh(std::move(mesh)), Transform());
+    }
+
+    // Builds the hierarchies of the spheres, of every mesh and of the instances, all taking their
+    // scratch memory from one arena.
+    void Build()
+    {
+        Arena scratch;
+        world.Build(scratch);
+        scratch.Reset();
+        instances.Build(scratch);
+    }
+
+    size_t TriangleCount() const
+    { return instances.InstancedTriangleCount(); }
+
+    bool Hit(const Ray &r, Interval rayT, HitRecord &rec) const override
+    {
+        bool hitAnything = world.Hit(r, rayT, rec);
+        if (instances.Hit(r, Interval(rayT.min, hitAnything ? rec.t : rayT.max), rec))
+        {
+            hitAnything = true;
+        }
+        return hitAnything;
+    }
+
+    Aabb BoundingBox() const override
+    { return Aabb(world.BoundingBox(), instances.BoundingBox()); }
+
+    // Hash of everything that decides what a Ray hits and how it scatters: the materials, spheres,
+    // meshes and instances. A distributed render compares it to check that every worker loaded the
+    // same scene.
+    uint64_t Fingerprint() const
+    {
+        uint64_t hash = 0;
+        auto add = [&](uint64_t bits)
+        { hash = (hash ^ MixBits(bits)) * 0x100000001b3ULL; };
+        auto addReal = [&](double value)
+        { add(std::bit_cast<uint64_t>(value)); };
+        auto addVector = [&](const Vec3 &v)
+        {
+            addReal(v.X());
+            addReal(v.Y());
+            addReal(v.Z());
+        };
+
+        add(materials.Size());
+        for (size_t m = 0; m < materials.Size(); m++)
+        {
+            const auto &mat = materials[MaterialId(m)];
+            add(mat.index());
+            addVector(Albedo(mat));
+            if (const auto *metal = std::get_if<Metal>(&mat))
+            {
+                addReal(metal->Fuzz());
+            }
+            if (const auto *dielectric = std::get_if<Dielectric>(&mat))
+            {
+                addReal(dielectric->RefractionIndex());
+            }
+        }
+
+        add(world.Size());
+        for (size_t i = 0; i < world.Size(); i++)
+        {
+            addVector(world.Center(i));
+            addVector(world.Motion(i));
+            addReal(world.Radius(i));
+            add(world.MaterialOf(i));
+        }
+
+        add(instances.MeshCount());
+        for (size_t k = 0; k < instances.MeshCount(); k++)
+        {
+            const auto &mesh = instances.Mesh(k);
+            add(mesh.MeshMaterial());
+            add(mesh.VertexCount());
+            for (const auto &v: mesh.Vertices())
+            {
+                addVector(v);
+            }
+            add(mesh.Indices().size());
+            for (auto index: mesh.Indices())
+            {
+                add(index);
+            }
+        }
+
+        add(instances.InstanceCount());
+        for (size_t i = 0; i < instances.InstanceCount(); i++)
+        {
+            const auto &instance = instances.Instance(i);
+            add(instance.mesh);
+            add(instance.material);
+            for (const auto &row: instance.worldToObject.m)
+            {
+                for (auto value: row)
+                {
+                    addReal(value);
+                }
+            }
+        }
+        return hash;
+    }
+};
+
+inline std::unique_ptr<Camera> SetupCamera()
+{
+    auto cam = std::make_unique<Camera>();
+
+    cam->aspectRatio = 16.0 / 9.0;
+    cam->imageWidth = 1200;
+    cam->samplesPerPixel = 100;
+    cam->maxDepth = 20;
+
+    cam->vFov = 20;
+    cam->lookFrom = Point3(13, 2, 3);
+    cam->lookAt = Point3(0, 0, 0);
+    cam->vUp = Vec3(0, 1, 0);
+
+    cam->defocusAngle = 0.6;
+    cam->focusDist = 10.0;
+
+    return cam;
+}
+
+inline void SetupMaterials(SphereSet &world, MaterialTable &materials)
+{
+    auto material1 = materials.Add(Dielectric(1.5));
+    world.Add(Point3(0, 1, 0), 1.0, material1);
+
+    auto material2 = materials.Add(Lambertian(Color(0.4, 0.2, 0.1)));
+    world.Add(Point3(-4, 1, 0), 1.0, material2);
+
+    auto material3 = materials.Add(Metal(Color(0.7, 0.6, 0.5), 0.0));
+    world.Add(Point3(4, 1, 0), 1.0, material3);
+}
+
+// With bouncing set, the diffuse spheres move upwards while the shutter is open, as in the motion
+// blur scene of the second book.
+inline SphereSet SetupWorld(MaterialTable &materials, bool bouncing = false)
+{
+    // World
+    SphereSet world;
+
+    auto groundMaterial = materials.Add(Lambertian(Color(0.5, 0.5, 0.5)));
+    world.Add(Point3(0, -1000, 0), 1000, groundMaterial);
+
+    for (int a = -11; a < 11; a++)
+    {
+        for (int b = -11; b < 11; b++)
+        {
+            auto chooseMat = RandomDouble();
+            Point3 center(a + 0.9 * RandomDouble(), 0.2, b + 0.9 * RandomDouble());
+
+            if ((center - Point3(4, 0.2, 0)).Length() > 0.9)
+            {
+                MaterialId sphereMaterial;
+
+                if (chooseMat < 0.8)
+                {
+                    // diffuse
+                    auto albedo = Color::random() * Color::random();
+                    sphereMaterial = materials.Add(Lambertian(albedo));
+                    if (bouncing)
+                    {
+                        world.AddMoving(center, center + Vec3(0, RandomDouble(0, 0.5), 0), 0.2, sphereMaterial);
+                    }
+                    else
+                    {
+                        world.Add(center, 0.2, sphereMaterial);
+                    }
+                }
+                else if (chooseMat < 0.95)
+                {
+                    // Metal
+                    auto albedo = Color::random(0.5, 1);
+                    auto fuzz = RandomDouble(0, 0.5);
+                    sphereMaterial = materials.Add(Metal(albedo, fuzz));
+                    world.Add(center, 0.2, sphereMaterial);
+                }
+                else
+                {
+                    // glass
+                    sphereMaterial = materials.Add(Dielectric(1.5));
+                    world.Add(center, 0.2, sphereMaterial);
+                }
+            }
+        }
+    }
+    return world;
+}
+
+// The final scene of the book: a ground plane, three large spheres and ~480 small random ones.
+inline Scene RandomSpheresScene()
+{
+    threadRng = Pcg32();
+
+    Scene scene;
+    scene.world = SetupWorld(scene.materials);
+    SetupMaterials(scene.world, scene.materials);
+    scene.camera = SetupCamera();
+    return scene;
+}
+
+// The final scene with its small diffuse spheres bouncing, blurred over the shutter interval.
+inline Scene MotionBlurScene()
+{
+    threadRng = Pcg32();
+
+    Scene scene;
+    scene.world = SetupWorld(scene.materials, true);
+    SetupMaterials(scene.world, scene.materials);
+    scene.camera = SetupCamera();
+    return scene;
+}
+
+// Only the ground and the three large spheres, so rendering cost is dominated by shading, not by
+// traversal.
+inline Scene LowSphereCountScene()
+{
+    threadRng = Pcg32();
+
+    Scene scene;
+    auto groundMaterial = scene.materials.Add(Lambertian(Color(0.5, 0.5, 0.5)));
+    scene.world.Add(Point3(0, -1000, 0), 1000, groundMaterial);
+    SetupMaterials(scene.world, scene.materials);
+    scene.camera = SetupCamera();
+    return scene;
+}
+
+// A grid of glass spheres in front of the three large ones. Dielectrics never absorb, so paths run
+// long and most of them reach the bounce limit.
+inline Scene GlassHeavyScene()
+{
+    threadRng = Pcg32();
+
+    Scene scene;
+    auto groundMaterial = scene.materials.Add(Lambertian(Color(0.5, 0.5, 0.5)));
+    scene.world.Add(Point3(0, -1000, 0), 1000, groundMaterial);
+
+    auto glass = scene.materials.Add(Dielectric(1.5));
+    auto bubble = scene.materials.Add(Dielectric(1.0 / 1.5));
+    for (int a = -8; a < 8; a++)
+    {
+        for (int b = -8; b < 8; b++)
+        {
+            Point3 center(a + 0.5 + 0.3 * RandomDouble(-1, 1), 0.35, b + 0.5 + 0.3 * RandomDouble(-1, 1));
+            scene.world.Add(center, 0.35, glass);
+            if (RandomDouble() < 0.5)
+            {
+                scene.world.Add(center, 0.25, bubble);
+            }
+        }
+    }
+
+    SetupMaterials(scene.world, scene.materials);
+    scene.camera = SetupCamera();
+    return scene;
+}
+
+// sphereCount small random spheres scattered over a 100 x 100 area, to stress the acceleration
+// structure rather than shading.
+inline Scene ManySpheresScene(int sphereCount = 100000)
+{
+    threadRng = Pcg32();
+
+    Scene scene;
+    scene.world.Reserve(size_t(sphereCount) + 1);
+    scene.materials.Reserve(size_t(sphereCount) + 1);
+    auto groundMaterial = scene.materials.Add(Lambertian(Color(0.5, 0.5, 0.5)));
+    scene.world.Add(Point3(0, -1000, 0), 1000, groundMaterial);
+
+    for (int n = 0; n < sphereCount; n++)
+    {
+        auto radius = RandomDouble(0.05, 0.2);
+        Point3 center(RandomDouble(-50, 50), radius + RandomDouble(0, 2), RandomDouble(-50, 50));
+
+        auto chooseMat = RandomDouble();
+        MaterialId sphereMaterial;
+        if (chooseMat < 0.8)
+        {
+            sphereMaterial = scene.materials.Add(Lambertian(Color::random() * Color::random()));
+        }
+        else if (chooseMat < 0.95)
+        {
+            sphereMaterial = scene.materials.Add(Metal(Color::random(0.5, 1), RandomDouble(0, 0.5)));
+        }
+        else
+        {
+            sphereMaterial = scene.materials.Add(Dielectric(1.5));
+        }
+        scene.world.Add(center, radius, sphereMaterial);
+    }
+
+    SetupMaterials(scene.world, scene.materials);
+    scene.camera = SetupCamera();
+    scene.camera->vFov = 40;
+    scene.camera->lookFrom = Point3(24, 6, 12);
+    scene.camera->defocusAngle = 0;
+    return scene;
+}
+
+// Sphere approximated by a closed triangle mesh of rings x segments quads, fanned into triangles at
+// the poles. Neighbouring triangles share their vertices, so the mesh has no cracks.
+inline TriangleMesh TessellatedSphere(const Point3 &center, Real radius, int rings, int segments, MaterialId mat)
+{
+    std::vector<Point3> vertices;
+    std::vector<uint32_t> indices;
+
+    vertices.push_back(center + Vec3(0, radius, 0));
+    for (int ring = 1; ring < rings; ring++)
+    {
+        auto theta = PI * ring / rings;
+        for (int segment = 0; segment < segments; segment++)
+        {
+            auto phi = 2 * PI * segment / segments;
+            vertices.push_back(center + radius * Vec3(std::sin(theta) * std::cos(phi), std::cos(theta),
+                                                      std::sin(theta) * std::sin(phi)));
+        }
+    }
+    vertices.push_back(center - Vec3(0, radius, 0));
+
+    auto ringVertex = [&](int ring, int segment)
+    { return uint32_t(1 + (ring - 1) * segments + segment % segments); };
+    auto bottom = uint32_t(vertices.size() - 1);
+
+    for (int segment = 0; segment < segments; segment++)
+    {
+        indices.insert(indices.end(), {0, ringVertex(1, segment + 1), ringVertex(1, segment)});
+        for (int ring = 1; ring + 1 < rings; ring++)
+        {
+            auto a = ringVertex(ring, segment), b = ringVertex(ring, segment + 1);
+            auto c = ringVertex(ring + 1, segment), d = ringVertex(ring + 1, segment + 1);
+            indices.insert(indices.end(), {a, b, d, a, d, c});
+        }
+        indices.insert(indices.end(), {bottom, ringVertex(rings - 1, segment), ringVertex(rings - 1, segment + 1)});
+    }
+
+    return TriangleMesh(std::move(vertices), std::move(indices), mat);
+}
+
+// The final scene with the three large spheres replaced by triangle meshes of about 65k triangles
+// each. The glass one shows cracks between triangles as dark speckles, should the intersection test
+// ever let Rays through shared edges.
+inline Scene TriangleMeshScene()
+{
+    threadRng = Pcg32();
+
+    Scene scene;
+    scene.world = SetupWorld(scene.materials);
+
+    auto glass = scene.materials.Add(Dielectric(1.5));
+    scene.AddMesh(TessellatedSphere(Point3(0, 1, 0), 1.0, 128, 256, glass));
+
+    auto diffuse = scene.materials.Add(Lambertian(Color(0.4, 0.2, 0.1)));
+    scene.AddMesh(TessellatedSphere(Point3(-4, 1, 0), 1.0, 128, 256, diffuse));
+
+    auto metal = scene.materials.Add(Metal(Color(0.7, 0.6, 0.5), 0.0));
+    scene.AddMesh(TessellatedSphere(Point3(4, 1, 0), 1.0, 128, 256, metal));
+
+    scene.camera = SetupCamera();
+    return scene;
+}
+
+// instanceCount pebbles scattered over a 200 x 200 area: one 960 triangle mesh placed with a random
+// rotation, squash and size every time, in a few materials. The mesh is stored once, so the scene takes
+// little more memory than its instances' transforms.
+inline Scene InstancedPebblesScene(int instanceCount = 1000000)
+{
+    threadRng = Pcg32();
+
+    Scene scene;
+    auto groundMaterial = scene.materials.Add(Lambertian(Color(0.5, 0.5, 0.5)));
+    scene.world.Add(Point3(0, -1000, 0), 1000, groundMaterial);
+
+    auto pebble = scene.instances.AddMesh(TessellatedSphere(Point3(0, 0, 0), 1.0, 16, 32, groundMaterial));
+    MaterialId pebbleMaterials[] = {
+            scene.materials.Add(Lambertian(Color(0.45, 0.4, 0.35))),
+            scene.materials.Add(Lambertian(Color(0.3, 0.3, 0.32))),
+            scene.materials.Add(Metal(Color(0.8, 0.7, 0.5), 0.3)),
+            scene.materials.Add(Dielectric(1.5)),
+    };
+
+    for (int n = 0; n < instanceCount; n++)
+    {
+        auto size = RandomDouble(0.05, 0.25);
+        auto squash = RandomDouble(0.4, 1.0);
+        Point3 position(RandomDouble(-100, 100), size * squash, RandomDouble(-100, 100));
+        auto objectToWorld = Transform::Translate(position) * Transform::Rotate(1, RandomDouble(0, 360))
+                             * Transform::Scale(size, size * squash, size * RandomDouble(0.6, 1.0));
+        scene.instances.AddInstance(pebble, objectToWorld, pebbleMaterials[int(RandomDouble() * 4)]);
+    }
+
+    SetupMaterials(scene.world, scene.materials);
+    scene.camera = SetupCamera();
+    scene.camera->lookFrom = Point3(13, 3, 3);
+    scene.camera->defocusAngle = 0;
+    return scene;
+}
+
+struct NamedScene
+{
+    const char *name;
+    Scene (*build)();
+};
+
+// The built-in scenes, selectable by name on the command line and rendered by the benchmark.
+inline const NamedScene builtinScenes[] = {
+        {"random_spheres", RandomSpheresScene},
+        {"low_sphere_count", LowSphereCountScene},
+        {"glass_heavy", GlassHeavyScene},
+        {"many_spheres", []() { return ManySpheresScene(100000); }},
+        {"motion_blur", MotionBlurScene},
+        {"triangle_meshes", TriangleMeshScene},
+        {"instanced_pebbles", []() { return InstancedPebblesScene(1000000); }},
+};
+
+#endif
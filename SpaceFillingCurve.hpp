@@ -0,0 +1,144 @@
+#ifndef SPACE_FILLING_CURVE_H
+#define SPACE_FILLING_CURVE_H
+
+#include "RTweekend.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Space filling curves order 2D and 3D grid cells so that cells close along the curve are close in
+// space. Camera visits tiles and pixels along one, so consecutive rays start from neighbouring pixels
+// and find the hierarchy nodes and primitives of the previous ones still in cache, and the wavefront
+// integrator sorts bounced rays along one through space.
+
+// Spreads the low 16 bits of v apart, one zero bit between every two.
+constexpr uint32_t SpreadBits2(uint32_t v)
+{
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+// Spreads the low 10 bits of v apart, two zero bits between every two.
+constexpr uint32_t SpreadBits3(uint32_t v)
+{
+    v &= 0x000003ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// Z-order index of cell (x, y), each coordinate below 2^16: the bits of x and y interleaved.
+constexpr uint32_t MortonCode2(uint32_t x, uint32_t y)
+{
+    return SpreadBits2(x) | (SpreadBits2(y) << 1);
+}
+
+// Z-order index of cell (x, y, z), each coordinate below 2^10.
+constexpr uint32_t MortonCode3(uint32_t x, uint32_t y, uint32_t z)
+{
+    return SpreadBits3(x) | (SpreadBits3(y) << 1) | (SpreadBits3(z) << 2);
+}
+
+// Index of cell (x, y) along the Hilbert curve through a grid of size by size cells, size a power of
+// two. Unlike the Z-order curve it never jumps: consecutive cells always share an edge.
+constexpr uint32_t HilbertIndex(uint32_t size, uint32_t x, uint32_t y)
+{
+    uint32_t index = 0;
+    for (uint32_t s = size / 2; s > 0; s /= 2)
+    {
+        uint32_t rx = (x & s) > 0;
+        uint32_t ry = (y & s) > 0;
+        index += s * s * ((3 * rx) ^ ry);
+
+        // Rotates the quadrant so that the curve inside it starts and ends at the right corners.
+        if (ry == 0)
+        {
+            if (rx == 1)
+            {
+                x = size - 1 - x;
+                y = size - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return index;
+}
+
+// Order in which Camera visits the tiles of the image and the pixels of every tile.
+enum class TileOrder
+{
+    Scanline,   // Row by row, left to right
+    Morton,     // Z-order: quadrants within quadrants
+    Hilbert     // Hilbert curve, the best locality
+};
+
+inline const char *TileOrderName(TileOrder order)
+{
+    switch (order)
+    {
+        case TileOrder::Scanline: return "scanline";
+        case TileOrder::Morton: return "morton";
+        default: return "hilbert";
+    }
+}
+
+inline TileOrder ParseTileOrder(const std::string &name)
+{
+    if (name == "scanline") return TileOrder::Scanline;
+    if (name == "morton") return TileOrder::Morton;
+    if (name == "hilbert") return TileOrder::Hilbert;
+    throw std::runtime_error("Unknown tile order " + name + ".");
+}
+
+// Index of cell (x, y) along order, for a grid that fits in size by size cells, size a power of two.
+constexpr uint32_t CurveIndex(TileOrder order, uint32_t size, uint32_t x, uint32_t y)
+{
+    switch (order)
+    {
+        case TileOrder::Scanline: return y * size + x;
+        case TileOrder::Morton: return MortonCode2(x, y);
+        default: return HilbertIndex(size, x, y);
+    }
+}
+
+// The cells of a width by height grid, as (x, y) pairs, in the order of the curve.
+struct GridCell
+{
+    uint16_t x, y;
+};
+
+inline std::vector<GridCell> CurveOrder(TileOrder order, int width, int height)
+{
+    uint32_t size = 1;
+    while (size < uint32_t(std::max(width, height)))
+    {
+        size *= 2;
+    }
+
+    std::vector<GridCell> cells;
+    cells.reserve(size_t(width) * height);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            cells.push_back({uint16_t(x), uint16_t(y)});
+        }
+    }
+
+    // Grids that aren't square powers of two keep the order of the enclosing one, skipping the cells
+    // outside.
+    std::stable_sort(cells.begin(), cells.end(), [order, size](GridCell a, GridCell b)
+    { return CurveIndex(order, size, a.x, a.y) < CurveIndex(order, size, b.x, b.y); });
+    return cells;
+}
+
+#endif
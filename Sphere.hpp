@@ -3,34 +3,58 @@
 
 #include "HitTable.hpp"
 #include "RTweekend.hpp"
+#include "RenderStats.hpp"
 
 class Sphere : public HitTable
 {
 public:
-    Sphere(const Point3& center, double radius, shared_ptr<Material> mat)
-            : center(center), radius(fmax(0,radius)), mat(mat) {}
+    Sphere(const Point3& center, Real radius, MaterialId mat)
+            : center(center), radius(std::max(Real(0), radius)), mat(mat)
+    {
+        auto rvec = Vec3(this->radius, this->radius, this->radius);
+        bbox = Aabb(center - rvec, center + rvec);
+    }
 
+    // Sphere moving in a straight line from center0 at time 0 to center1 at time 1. Its box bounds the
+    // whole sweep.
+    Sphere(const Point3 &center0, const Point3 &center1, Real radius, MaterialId mat)
+            : center(center0), motion(center1 - center0), radius(std::max(Real(0), radius)), mat(mat)
+    {
+        auto rvec = Vec3(this->radius, this->radius, this->radius);
+        bbox = Aabb(Aabb(center0 - rvec, center0 + rvec), Aabb(center1 - rvec, center1 + rvec));
+    }
 
     bool Hit(const Ray &r, Interval rayT, HitRecord &rec) const override
     {
-        Vec3 oc = center - r.origin();
+        RT_STAT(threadStats.sphereTests++);
+        Point3 currentCenter = center + r.time() * motion;
+        Vec3 oc = currentCenter - r.origin();
         auto a = r.direction().LengthSquared();
         auto h = Dot(r.direction(), oc);
         auto c = oc.LengthSquared() - radius * radius;
 
-        auto discriminant = h * h - a * c;
+        // h * h - a * c, rewritten with the offset of the center from the Ray so that it doesn't
+        // cancel catastrophically for large spheres (Ray Tracing Gems, chapter 7).
+        Vec3 l = oc - (h / a) * r.direction();
+        auto discriminant = a * (radius * radius - l.LengthSquared());
         if (discriminant < 0)
         {
             return false;
         }
 
-        auto sqrtD = sqrt(discriminant);
+        // q never subtracts nearly equal values, and c / q stays accurate for roots close to zero. q is
+        // only zero for a Ray grazing the sphere with h == 0, whose single root is h / a; c / q would be
+        // inf or NaN there.
+        auto q = h + std::copysign(sqrt(discriminant), h);
+        auto otherRoot = q != 0 ? c / q : q / a;
+        auto nearRoot = std::min(q / a, otherRoot);
+        auto farRoot = std::max(q / a, otherRoot);
 
         // Find the nearest root that lies in the acceptable range.
-        auto root = (h - sqrtD) / a;
+        auto root = nearRoot;
         if (!rayT.Surrounds(root))
         {
-            root = (h + sqrtD) / a;
+            root = farRoot;
             if (root <= rayT.min || rayT.max <= root)
             {
                 return false;
@@ -39,17 +63,24 @@ public:
 
         rec.t = root;
         rec.p = r.at(rec.t);
-        Vec3 outwardNormal = (rec.p - center) / radius;
+        rec.pError = HitPositionError(MaxAbsComponent(r.origin()) + MaxAbsComponent(currentCenter) + radius);
+        Vec3 outwardNormal = (rec.p - currentCenter) / radius;
         rec.SetFaceNormal(r, outwardNormal);
         rec.mat = mat;
+        RT_STAT(threadStats.sphereHits++);
 
         return true;
     }
 
+    Aabb BoundingBox() const override
+    { return bbox; }
+
 private:
-    Point3 center;
-    double radius;
-    shared_ptr<Material> mat;
+    Point3 center;      // Center at time 0
+    Vec3 motion;        // Distance the center moves from time 0 to time 1
+    Real radius;
+    MaterialId mat;
+    Aabb bbox;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,684 @@
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+#include "RTweekend.hpp"
+#include "HitTable.hpp"
+#include "FlatBvh.hpp"
+#include "Arena.hpp"
+#include "AlignedAllocator.hpp"
+#include "RenderStats.hpp"
+
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define RT_SPHERE_SET_X86 1
+#include <immintrin.h>
+#endif
+
+// Spheres stored as a structure of arrays (centers, radii and material indices in separate aligned
+// arrays), intersected several at a time with SIMD. After Build(), an internal FlatBvh groups the
+// spheres into small leaves that are each tested with one pass of the SIMD kernel.
+class SphereSet : public HitTable
+{
+public:
+    static constexpr int DefaultLeafSize = 8;   // Two AVX2 iterations per leaf
+
+    void Add(const Point3 &center, Real radius, MaterialId mat)
+    {
+        radius = std::max(Real(0), radius);
+        centerX.push_back(center.X());
+        centerY.push_back(center.Y());
+        centerZ.push_back(center.Z());
+        radii.push_back(radius);
+        materialIndex.push_back(mat);
+        if (HasMotion())
+        {
+            motionX.push_back(0);
+            motionY.push_back(0);
+            motionZ.push_back(0);
+        }
+
+        auto rvec = Vec3(radius, radius, radius);
+        bbox = Aabb(bbox, Aabb(center - rvec, center + rvec));
+    }
+
+    // Sphere moving in a straight line from center0 at time 0 to center1 at time 1.
+    void AddMoving(const Point3 &center0, const Point3 &center1, Real radius, MaterialId mat)
+    {
+        EnableMotion();
+        Add(center0, radius, mat);
+
+        auto motion = center1 - center0;
+        motionX.back() = motion.X();
+        motionY.back() = motion.Y();
+        motionZ.back() = motion.Z();
+        bbox = Aabb(bbox, SweptBounds(Size() - 1));
+    }
+
+    // Appends count spheres given as separate coordinate, radius and material arrays, the layout
+    // of the binary scene file, so a loaded scene is copied straight into the internal arrays. The
+    // motion arrays are optional and hold the distance every center moves from time 0 to time 1.
+    void Append(const double *x, const double *y, const double *z, const double *radius, const MaterialId *mat,
+                size_t count, const double *mx = nullptr, const double *my = nullptr, const double *mz = nullptr)
+    {
+        if (mx != nullptr)
+        {
+            EnableMotion();
+            motionX.insert(motionX.end(), mx, mx + count);
+            motionY.insert(motionY.end(), my, my + count);
+            motionZ.insert(motionZ.end(), mz, mz + count);
+        }
+        else if (HasMotion())
+        {
+            motionX.resize(motionX.size() + count, 0);
+            motionY.resize(motionY.size() + count, 0);
+            motionZ.resize(motionZ.size() + count, 0);
+        }
+
+        centerX.insert(centerX.end(), x, x + count);
+        centerY.insert(centerY.end(), y, y + count);
+        centerZ.insert(centerZ.end(), z, z + count);
+        radii.insert(radii.end(), radius, radius + count);
+        materialIndex.insert(materialIndex.end(), mat, mat + count);
+
+        for (size_t i = radii.size() - count; i < radii.size(); i++)
+        {
+            radii[i] = std::max(Real(0), radii[i]);
+            bbox = Aabb(bbox, SweptBounds(i));
+        }
+    }
+
+    void Reserve(size_t count)
+    {
+        centerX.reserve(count);
+        centerY.reserve(count);
+        centerZ.reserve(count);
+        radii.reserve(count);
+        materialIndex.reserve(count);
+        if (HasMotion())
+        {
+            motionX.reserve(count);
+            motionY.reserve(count);
+            motionZ.reserve(count);
+        }
+    }
+
+    size_t Size() const
+    { return radii.size(); }
+
+    // Whether any sphere moves. Only then are the motion arrays stored and read.
+    bool HasMotion() const
+    { return moving; }
+
+    Point3 Center(size_t i) const
+    { return Point3(centerX[i], centerY[i], centerZ[i]); }
+
+    Vec3 Motion(size_t i) const
+    { return HasMotion() ? Vec3(motionX[i], motionY[i], motionZ[i]) : Vec3(0, 0, 0); }
+
+    Point3 CenterAt(size_t i, Real time) const
+    { return HasMotion() ? Center(i) + time * Motion(i) : Center(i); }
+
+    Real Radius(size_t i) const
+    { return radii[i]; }
+
+    MaterialId MaterialOf(size_t i) const
+    { return materialIndex[i]; }
+
+    // Builds the internal hierarchy and reorders the arrays so that every leaf is contiguous. The
+    // builder's temporary arrays come from scratch.
+    void Build(Arena &scratch, int maxLeafSize = DefaultLeafSize)
+    {
+        auto order = bvh.Build(Size(), [this](uint32_t i)
+        {
+            if (HasMotion())
+            {
+                return SweptBounds(i);
+            }
+            auto rvec = Vec3(radii[i], radii[i], radii[i]);
+            auto center = Point3(centerX[i], centerY[i], centerZ[i]);
+            return Aabb(center - rvec, center + rvec);
+        }, maxLeafSize, scratch);
+
+        Permute(centerX, order);
+        Permute(centerY, order);
+        Permute(centerZ, order);
+        Permute(radii, order);
+        Permute(materialIndex, order);
+        if (HasMotion())
+        {
+            Permute(motionX, order);
+            Permute(motionY, order);
+            Permute(motionZ, order);
+        }
+    }
+
+    void Build(int maxLeafSize = DefaultLeafSize)
+    {
+        Arena scratch;
+        Build(scratch, maxLeafSize);
+    }
+
+    bool Hit(const Ray &r, Interval rayT, HitRecord &rec) const override
+    {
+        if (bvh.Empty())
+        {
+            return HitRange(r, 0, uint32_t(Size()), rayT, rec);
+        }
+
+        return bvh.Traverse(r, rayT, [&](uint32_t first, uint32_t count, Interval &t)
+        {
+            if (!HitRange(r, first, count, t, rec))
+            {
+                return false;
+            }
+            t.max = rec.t;
+            return true;
+        });
+    }
+
+    Aabb BoundingBox() const override
+    { return bbox; }
+
+private:
+    AlignedVector<Real> centerX, centerY, centerZ, radii;
+    AlignedVector<Real> motionX, motionY, motionZ;  // Empty until a sphere moves
+    bool moving = false;
+    AlignedVector<MaterialId> materialIndex;
+    FlatBvh bvh;
+    Aabb bbox;
+
+    void EnableMotion()
+    {
+        if (!moving)
+        {
+            motionX.assign(Size(), 0);
+            motionY.assign(Size(), 0);
+            motionZ.assign(Size(), 0);
+            moving = true;
+        }
+    }
+
+    // Box around sphere i over the whole time interval [0, 1], so the hierarchy bounds its sweep and
+    // a blurred frame traverses it as fast as a static one.
+    Aabb SweptBounds(size_t i) const
+    {
+        auto rvec = Vec3(radii[i], radii[i], radii[i]);
+        auto center0 = Center(i);
+        auto center1 = center0 + Motion(i);
+        return Aabb(Aabb(center0 - rvec, center0 + rvec), Aabb(center1 - rvec, center1 + rvec));
+    }
+
+    template<typename Vector>
+    static void Permute(Vector &values, const std::vector<uint32_t> &order)
+    {
+        Vector permuted(values.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            permuted[i] = values[order[i]];
+        }
+        values.swap(permuted);
+    }
+
+    // Tests the spheres [first, first + count) and fills rec for the closest hit inside rayT.
+    bool HitRange(const Ray &r, uint32_t first, uint32_t count, Interval rayT, HitRecord &rec) const
+    {
+        int closest = -1;
+        Real closestT = rayT.max;
+        RT_STAT(threadStats.sphereTests += count);
+
+        // Static sets keep kernels without the motion arrays, so motion blur support costs them nothing.
+#ifdef RT_SPHERE_SET_X86
+        static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+        if (hasAvx2)
+        {
+            closest = HasMotion() ? ClosestAvx2<true>(r, first, count, rayT.min, closestT)
+                                  : ClosestAvx2<false>(r, first, count, rayT.min, closestT);
+        }
+        else
+        {
+            closest = HasMotion() ? ClosestSse2<true>(r, first, count, rayT.min, closestT)
+                                  : ClosestSse2<false>(r, first, count, rayT.min, closestT);
+        }
+#else
+        closest = HasMotion() ? ClosestScalar<true>(r, first, first + count, rayT.min, closestT)
+                              : ClosestScalar<false>(r, first, first + count, rayT.min, closestT);
+#endif
+
+        if (closest < 0)
+        {
+            return false;
+        }
+        RT_STAT(threadStats.sphereHits++);
+
+        auto center = CenterAt(size_t(closest), r.time());
+        rec.t = closestT;
+        rec.p = r.at(rec.t);
+        rec.pError = HitPositionError(MaxAbsComponent(r.origin()) + MaxAbsComponent(center) + radii[closest]);
+        Vec3 outwardNormal = (rec.p - center) / radii[closest];
+        rec.SetFaceNormal(r, outwardNormal);
+        rec.mat = materialIndex[closest];
+
+        return true;
+    }
+
+    // Same arithmetic as Sphere::Hit, one sphere at a time. Used on targets without a SIMD kernel and
+    // for the remainder that doesn't fill a whole vector.
+    template<bool Moving>
+    int ClosestScalar(const Ray &r, uint32_t begin, uint32_t end, Real tMin, Real &tMax) const
+    {
+        int closest = -1;
+        const Point3 &o = r.origin();
+        const Vec3 &d = r.direction();
+        auto a = d.LengthSquared();
+
+        for (uint32_t k = begin; k < end; k++)
+        {
+            Point3 center(centerX[k], centerY[k], centerZ[k]);
+            if constexpr (Moving)
+            {
+                center += r.time() * Vec3(motionX[k], motionY[k], motionZ[k]);
+            }
+            Vec3 oc = center - o;
+            auto h = Dot(d, oc);
+            auto c = oc.LengthSquared() - radii[k] * radii[k];
+
+            Vec3 l = oc - (h / a) * d;
+            auto discriminant = a * (radii[k] * radii[k] - l.LengthSquared());
+            if (discriminant < 0)
+            {
+                continue;
+            }
+
+            // q is only zero for a grazing Ray with h == 0, whose single root is h / a.
+            auto q = h + std::copysign(sqrt(discriminant), h);
+            auto otherRoot = q != 0 ? c / q : q / a;
+            auto root = std::min(q / a, otherRoot);
+            if (root <= tMin || tMax <= root)
+            {
+                root = std::max(q / a, otherRoot);
+                if (root <= tMin || tMax <= root)
+                {
+                    continue;
+                }
+            }
+
+            tMax = root;
+            closest = int(k);
+        }
+
+        return closest;
+    }
+
+#ifdef RT_SPHERE_SET_X86
+#ifdef RT_USE_FLOAT
+    // Single precision kernels: eight spheres per AVX2 iteration, four per SSE iteration.
+    template<bool Moving>
+    __attribute__((target("avx2")))
+    int ClosestAvx2(const Ray &r, uint32_t first, uint32_t count, float tMin, float &tMax) const
+    {
+        const Point3 &o = r.origin();
+        const Vec3 &d = r.direction();
+
+        const __m256 ox = _mm256_set1_ps(o.X()), oy = _mm256_set1_ps(o.Y()), oz = _mm256_set1_ps(o.Z());
+        const __m256 dx = _mm256_set1_ps(d.X()), dy = _mm256_set1_ps(d.Y()), dz = _mm256_set1_ps(d.Z());
+        const __m256 time = _mm256_set1_ps(r.time());
+        const __m256 a = _mm256_set1_ps(d.LengthSquared());
+        const __m256 vMin = _mm256_set1_ps(tMin);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 signBit = _mm256_set1_ps(-0.0f);
+        const __m256 inf = _mm256_set1_ps(RT_INFINITY);
+        __m256 vMax = _mm256_set1_ps(tMax);
+
+        int closest = -1;
+        uint32_t k = first;
+        const uint32_t end = first + count;
+
+        for (; k + 8 <= end; k += 8)
+        {
+            __m256 cx = _mm256_loadu_ps(&centerX[k]);
+            __m256 cy = _mm256_loadu_ps(&centerY[k]);
+            __m256 cz = _mm256_loadu_ps(&centerZ[k]);
+            if constexpr (Moving)
+            {
+                cx = _mm256_add_ps(cx, _mm256_mul_ps(time, _mm256_loadu_ps(&motionX[k])));
+                cy = _mm256_add_ps(cy, _mm256_mul_ps(time, _mm256_loadu_ps(&motionY[k])));
+                cz = _mm256_add_ps(cz, _mm256_mul_ps(time, _mm256_loadu_ps(&motionZ[k])));
+            }
+            __m256 ocx = _mm256_sub_ps(cx, ox);
+            __m256 ocy = _mm256_sub_ps(cy, oy);
+            __m256 ocz = _mm256_sub_ps(cz, oz);
+            __m256 radSquared = _mm256_mul_ps(_mm256_loadu_ps(&radii[k]), _mm256_loadu_ps(&radii[k]));
+
+            __m256 h = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, ocx), _mm256_mul_ps(dy, ocy)),
+                                     _mm256_mul_ps(dz, ocz));
+            __m256 ocLen = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocx, ocx), _mm256_mul_ps(ocy, ocy)),
+                                         _mm256_mul_ps(ocz, ocz));
+            __m256 c = _mm256_sub_ps(ocLen, radSquared);
+
+            __m256 hOverA = _mm256_div_ps(h, a);
+            __m256 lx = _mm256_sub_ps(ocx, _mm256_mul_ps(hOverA, dx));
+            __m256 ly = _mm256_sub_ps(ocy, _mm256_mul_ps(hOverA, dy));
+            __m256 lz = _mm256_sub_ps(ocz, _mm256_mul_ps(hOverA, dz));
+            __m256 lLen = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)),
+                                        _mm256_mul_ps(lz, lz));
+            __m256 discriminant = _mm256_mul_ps(a, _mm256_sub_ps(radSquared, lLen));
+            __m256 valid = _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ);
+            if (_mm256_movemask_ps(valid) == 0)
+            {
+                continue;
+            }
+
+            __m256 sqrtD = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+            __m256 q = _mm256_add_ps(h, _mm256_or_ps(sqrtD, _mm256_and_ps(h, signBit)));
+            // Lanes with q == 0, grazing Rays with h == 0, have the single root q / a.
+            __m256 rootB = _mm256_div_ps(q, a);
+            __m256 rootA = _mm256_blendv_ps(_mm256_div_ps(c, q), rootB, _mm256_cmp_ps(q, zero, _CMP_EQ_OQ));
+            __m256 nearT = _mm256_min_ps(rootA, rootB);
+            __m256 farT = _mm256_max_ps(rootA, rootB);
+
+            __m256 nearHit = _mm256_and_ps(_mm256_cmp_ps(nearT, vMin, _CMP_GT_OQ),
+                                           _mm256_cmp_ps(nearT, vMax, _CMP_LT_OQ));
+            __m256 farHit = _mm256_and_ps(_mm256_cmp_ps(farT, vMin, _CMP_GT_OQ),
+                                          _mm256_cmp_ps(farT, vMax, _CMP_LT_OQ));
+
+            // Nearest valid root per lane, infinity where the lane misses.
+            __m256 t = _mm256_blendv_ps(_mm256_blendv_ps(inf, farT, farHit), nearT, nearHit);
+            t = _mm256_blendv_ps(inf, t, valid);
+
+            int mask = _mm256_movemask_ps(_mm256_cmp_ps(t, vMax, _CMP_LT_OQ));
+            if (mask == 0)
+            {
+                continue;
+            }
+
+            alignas(32) float lanes[8];
+            _mm256_store_ps(lanes, t);
+            for (int lane = 0; lane < 8; lane++)
+            {
+                if ((mask & (1 << lane)) && lanes[lane] < tMax)
+                {
+                    tMax = lanes[lane];
+                    closest = int(k) + lane;
+                }
+            }
+            vMax = _mm256_set1_ps(tMax);
+        }
+
+        int tail = ClosestScalar<Moving>(r, k, end, tMin, tMax);
+        return tail >= 0 ? tail : closest;
+    }
+
+    template<bool Moving>
+    int ClosestSse2(const Ray &r, uint32_t first, uint32_t count, float tMin, float &tMax) const
+    {
+        const Point3 &o = r.origin();
+        const Vec3 &d = r.direction();
+
+        const __m128 ox = _mm_set1_ps(o.X()), oy = _mm_set1_ps(o.Y()), oz = _mm_set1_ps(o.Z());
+        const __m128 dx = _mm_set1_ps(d.X()), dy = _mm_set1_ps(d.Y()), dz = _mm_set1_ps(d.Z());
+        const __m128 time = _mm_set1_ps(r.time());
+        const __m128 a = _mm_set1_ps(d.LengthSquared());
+        const __m128 vMin = _mm_set1_ps(tMin);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+        __m128 vMax = _mm_set1_ps(tMax);
+
+        int closest = -1;
+        uint32_t k = first;
+        const uint32_t end = first + count;
+
+        for (; k + 4 <= end; k += 4)
+        {
+            __m128 cx = _mm_loadu_ps(&centerX[k]);
+            __m128 cy = _mm_loadu_ps(&centerY[k]);
+            __m128 cz = _mm_loadu_ps(&centerZ[k]);
+            if constexpr (Moving)
+            {
+                cx = _mm_add_ps(cx, _mm_mul_ps(time, _mm_loadu_ps(&motionX[k])));
+                cy = _mm_add_ps(cy, _mm_mul_ps(time, _mm_loadu_ps(&motionY[k])));
+                cz = _mm_add_ps(cz, _mm_mul_ps(time, _mm_loadu_ps(&motionZ[k])));
+            }
+            __m128 ocx = _mm_sub_ps(cx, ox);
+            __m128 ocy = _mm_sub_ps(cy, oy);
+            __m128 ocz = _mm_sub_ps(cz, oz);
+            __m128 radSquared = _mm_mul_ps(_mm_loadu_ps(&radii[k]), _mm_loadu_ps(&radii[k]));
+
+            __m128 h = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, ocx), _mm_mul_ps(dy, ocy)), _mm_mul_ps(dz, ocz));
+            __m128 ocLen = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz));
+            __m128 c = _mm_sub_ps(ocLen, radSquared);
+
+            __m128 hOverA = _mm_div_ps(h, a);
+            __m128 lx = _mm_sub_ps(ocx, _mm_mul_ps(hOverA, dx));
+            __m128 ly = _mm_sub_ps(ocy, _mm_mul_ps(hOverA, dy));
+            __m128 lz = _mm_sub_ps(ocz, _mm_mul_ps(hOverA, dz));
+            __m128 lLen = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz));
+            __m128 discriminant = _mm_mul_ps(a, _mm_sub_ps(radSquared, lLen));
+            __m128 valid = _mm_cmpge_ps(discriminant, zero);
+            if (_mm_movemask_ps(valid) == 0)
+            {
+                continue;
+            }
+
+            __m128 sqrtD = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+            __m128 q = _mm_add_ps(h, _mm_or_ps(sqrtD, _mm_and_ps(h, signBit)));
+            __m128 rootB = _mm_div_ps(q, a);
+            __m128 grazing = _mm_cmpeq_ps(q, zero);
+            __m128 rootA = _mm_or_ps(_mm_and_ps(grazing, rootB), _mm_andnot_ps(grazing, _mm_div_ps(c, q)));
+            __m128 nearT = _mm_min_ps(rootA, rootB);
+            __m128 farT = _mm_max_ps(rootA, rootB);
+
+            __m128 nearInRange = _mm_and_ps(_mm_cmpgt_ps(nearT, vMin), _mm_cmplt_ps(nearT, vMax));
+            __m128 farInRange = _mm_and_ps(_mm_cmpgt_ps(farT, vMin), _mm_cmplt_ps(farT, vMax));
+            int nearMask = _mm_movemask_ps(_mm_and_ps(valid, nearInRange));
+            int farMask = _mm_movemask_ps(_mm_and_ps(valid, farInRange));
+            if ((nearMask | farMask) == 0)
+            {
+                continue;
+            }
+
+            alignas(16) float nearLanes[4], farLanes[4];
+            _mm_store_ps(nearLanes, nearT);
+            _mm_store_ps(farLanes, farT);
+            for (int lane = 0; lane < 4; lane++)
+            {
+                float t = (nearMask & (1 << lane)) ? nearLanes[lane] : farLanes[lane];
+                if (((nearMask | farMask) & (1 << lane)) && t < tMax)
+                {
+                    tMax = t;
+                    closest = int(k) + lane;
+                }
+            }
+            vMax = _mm_set1_ps(tMax);
+        }
+
+        int tail = ClosestScalar<Moving>(r, k, end, tMin, tMax);
+        return tail >= 0 ? tail : closest;
+    }
+#else
+    template<bool Moving>
+    __attribute__((target("avx2")))
+    int ClosestAvx2(const Ray &r, uint32_t first, uint32_t count, double tMin, double &tMax) const
+    {
+        const Point3 &o = r.origin();
+        const Vec3 &d = r.direction();
+
+        const __m256d ox = _mm256_set1_pd(o.X()), oy = _mm256_set1_pd(o.Y()), oz = _mm256_set1_pd(o.Z());
+        const __m256d dx = _mm256_set1_pd(d.X()), dy = _mm256_set1_pd(d.Y()), dz = _mm256_set1_pd(d.Z());
+        const __m256d time = _mm256_set1_pd(r.time());
+        const __m256d a = _mm256_set1_pd(d.LengthSquared());
+        const __m256d vMin = _mm256_set1_pd(tMin);
+        const __m256d zero = _mm256_setzero_pd();
+        const __m256d signBit = _mm256_set1_pd(-0.0);
+        const __m256d inf = _mm256_set1_pd(RT_INFINITY);
+        __m256d vMax = _mm256_set1_pd(tMax);
+
+        int closest = -1;
+        uint32_t k = first;
+        const uint32_t end = first + count;
+
+        for (; k + 4 <= end; k += 4)
+        {
+            __m256d cx = _mm256_loadu_pd(&centerX[k]);
+            __m256d cy = _mm256_loadu_pd(&centerY[k]);
+            __m256d cz = _mm256_loadu_pd(&centerZ[k]);
+            if constexpr (Moving)
+            {
+                cx = _mm256_add_pd(cx, _mm256_mul_pd(time, _mm256_loadu_pd(&motionX[k])));
+                cy = _mm256_add_pd(cy, _mm256_mul_pd(time, _mm256_loadu_pd(&motionY[k])));
+                cz = _mm256_add_pd(cz, _mm256_mul_pd(time, _mm256_loadu_pd(&motionZ[k])));
+            }
+            __m256d ocx = _mm256_sub_pd(cx, ox);
+            __m256d ocy = _mm256_sub_pd(cy, oy);
+            __m256d ocz = _mm256_sub_pd(cz, oz);
+            __m256d radSquared = _mm256_mul_pd(_mm256_loadu_pd(&radii[k]), _mm256_loadu_pd(&radii[k]));
+
+            __m256d h = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, ocx), _mm256_mul_pd(dy, ocy)),
+                                      _mm256_mul_pd(dz, ocz));
+            __m256d ocLen = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)),
+                                          _mm256_mul_pd(ocz, ocz));
+            __m256d c = _mm256_sub_pd(ocLen, radSquared);
+
+            __m256d hOverA = _mm256_div_pd(h, a);
+            __m256d lx = _mm256_sub_pd(ocx, _mm256_mul_pd(hOverA, dx));
+            __m256d ly = _mm256_sub_pd(ocy, _mm256_mul_pd(hOverA, dy));
+            __m256d lz = _mm256_sub_pd(ocz, _mm256_mul_pd(hOverA, dz));
+            __m256d lLen = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(lx, lx), _mm256_mul_pd(ly, ly)),
+                                         _mm256_mul_pd(lz, lz));
+            __m256d discriminant = _mm256_mul_pd(a, _mm256_sub_pd(radSquared, lLen));
+            __m256d valid = _mm256_cmp_pd(discriminant, zero, _CMP_GE_OQ);
+            if (_mm256_movemask_pd(valid) == 0)
+            {
+                continue;
+            }
+
+            __m256d sqrtD = _mm256_sqrt_pd(_mm256_max_pd(discriminant, zero));
+            __m256d q = _mm256_add_pd(h, _mm256_or_pd(sqrtD, _mm256_and_pd(h, signBit)));
+            __m256d rootB = _mm256_div_pd(q, a);
+            __m256d rootA = _mm256_blendv_pd(_mm256_div_pd(c, q), rootB, _mm256_cmp_pd(q, zero, _CMP_EQ_OQ));
+            __m256d nearT = _mm256_min_pd(rootA, rootB);
+            __m256d farT = _mm256_max_pd(rootA, rootB);
+
+            __m256d nearHit = _mm256_and_pd(_mm256_cmp_pd(nearT, vMin, _CMP_GT_OQ),
+                                            _mm256_cmp_pd(nearT, vMax, _CMP_LT_OQ));
+            __m256d farHit = _mm256_and_pd(_mm256_cmp_pd(farT, vMin, _CMP_GT_OQ),
+                                           _mm256_cmp_pd(farT, vMax, _CMP_LT_OQ));
+
+            // Nearest valid root per lane, infinity where the lane misses.
+            __m256d t = _mm256_blendv_pd(_mm256_blendv_pd(inf, farT, farHit), nearT, nearHit);
+            t = _mm256_blendv_pd(inf, t, valid);
+
+            int mask = _mm256_movemask_pd(_mm256_cmp_pd(t, vMax, _CMP_LT_OQ));
+            if (mask == 0)
+            {
+                continue;
+            }
+
+            alignas(32) double lanes[4];
+            _mm256_store_pd(lanes, t);
+            for (int lane = 0; lane < 4; lane++)
+            {
+                if ((mask & (1 << lane)) && lanes[lane] < tMax)
+                {
+                    tMax = lanes[lane];
+                    closest = int(k) + lane;
+                }
+            }
+            vMax = _mm256_set1_pd(tMax);
+        }
+
+        int tail = ClosestScalar<Moving>(r, k, end, tMin, tMax);
+        return tail >= 0 ? tail : closest;
+    }
+
+    template<bool Moving>
+    int ClosestSse2(const Ray &r, uint32_t first, uint32_t count, double tMin, double &tMax) const
+    {
+        const Point3 &o = r.origin();
+        const Vec3 &d = r.direction();
+
+        const __m128d ox = _mm_set1_pd(o.X()), oy = _mm_set1_pd(o.Y()), oz = _mm_set1_pd(o.Z());
+        const __m128d dx = _mm_set1_pd(d.X()), dy = _mm_set1_pd(d.Y()), dz = _mm_set1_pd(d.Z());
+        const __m128d time = _mm_set1_pd(r.time());
+        const __m128d a = _mm_set1_pd(d.LengthSquared());
+        const __m128d vMin = _mm_set1_pd(tMin);
+        const __m128d zero = _mm_setzero_pd();
+        const __m128d signBit = _mm_set1_pd(-0.0);
+        __m128d vMax = _mm_set1_pd(tMax);
+
+        int closest = -1;
+        uint32_t k = first;
+        const uint32_t end = first + count;
+
+        for (; k + 2 <= end; k += 2)
+        {
+            __m128d cx = _mm_loadu_pd(&centerX[k]);
+            __m128d cy = _mm_loadu_pd(&centerY[k]);
+            __m128d cz = _mm_loadu_pd(&centerZ[k]);
+            if constexpr (Moving)
+            {
+                cx = _mm_add_pd(cx, _mm_mul_pd(time, _mm_loadu_pd(&motionX[k])));
+                cy = _mm_add_pd(cy, _mm_mul_pd(time, _mm_loadu_pd(&motionY[k])));
+                cz = _mm_add_pd(cz, _mm_mul_pd(time, _mm_loadu_pd(&motionZ[k])));
+            }
+            __m128d ocx = _mm_sub_pd(cx, ox);
+            __m128d ocy = _mm_sub_pd(cy, oy);
+            __m128d ocz = _mm_sub_pd(cz, oz);
+            __m128d radSquared = _mm_mul_pd(_mm_loadu_pd(&radii[k]), _mm_loadu_pd(&radii[k]));
+
+            __m128d h = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, ocx), _mm_mul_pd(dy, ocy)), _mm_mul_pd(dz, ocz));
+            __m128d ocLen = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, ocx), _mm_mul_pd(ocy, ocy)), _mm_mul_pd(ocz, ocz));
+            __m128d c = _mm_sub_pd(ocLen, radSquared);
+
+            __m128d hOverA = _mm_div_pd(h, a);
+            __m128d lx = _mm_sub_pd(ocx, _mm_mul_pd(hOverA, dx));
+            __m128d ly = _mm_sub_pd(ocy, _mm_mul_pd(hOverA, dy));
+            __m128d lz = _mm_sub_pd(ocz, _mm_mul_pd(hOverA, dz));
+            __m128d lLen = _mm_add_pd(_mm_add_pd(_mm_mul_pd(lx, lx), _mm_mul_pd(ly, ly)), _mm_mul_pd(lz, lz));
+            __m128d discriminant = _mm_mul_pd(a, _mm_sub_pd(radSquared, lLen));
+            __m128d valid = _mm_cmpge_pd(discriminant, zero);
+            if (_mm_movemask_pd(valid) == 0)
+            {
+                continue;
+            }
+
+            __m128d sqrtD = _mm_sqrt_pd(_mm_max_pd(discriminant, zero));
+            __m128d q = _mm_add_pd(h, _mm_or_pd(sqrtD, _mm_and_pd(h, signBit)));
+            __m128d rootB = _mm_div_pd(q, a);
+            __m128d grazing = _mm_cmpeq_pd(q, zero);
+            __m128d rootA = _mm_or_pd(_mm_and_pd(grazing, rootB), _mm_andnot_pd(grazing, _mm_div_pd(c, q)));
+            __m128d nearT = _mm_min_pd(rootA, rootB);
+            __m128d farT = _mm_max_pd(rootA, rootB);
+
+            __m128d nearInRange = _mm_and_pd(_mm_cmpgt_pd(nearT, vMin), _mm_cmplt_pd(nearT, vMax));
+            __m128d farInRange = _mm_and_pd(_mm_cmpgt_pd(farT, vMin), _mm_cmplt_pd(farT, vMax));
+            int nearMask = _mm_movemask_pd(_mm_and_pd(valid, nearInRange));
+            int farMask = _mm_movemask_pd(_mm_and_pd(valid, farInRange));
+            if ((nearMask | farMask) == 0)
+            {
+                continue;
+            }
+
+            alignas(16) double nearLanes[2], farLanes[2];
+            _mm_store_pd(nearLanes, nearT);
+            _mm_store_pd(farLanes, farT);
+            for (int lane = 0; lane < 2; lane++)
+            {
+                double t = (nearMask & (1 << lane)) ? nearLanes[lane] : farLanes[lane];
+                if (((nearMask | farMask) & (1 << lane)) && t < tMax)
+                {
+                    tMax = t;
+                    closest = int(k) + lane;
+                }
+            }
+            vMax = _mm_set1_pd(tMax);
+        }
+
+        int tail = ClosestScalar<Moving>(r, k, end, tMin, tMax);
+        return tail >= 0 ? tail : closest;
+    }
+#endif
+#endif
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that stay alive between jobs, so rendering many frames or progressive
+// passes doesn't pay for thread creation every time and thread_local state (the per-thread stats) is
+// reused. A job runs once on every worker, job(threadNum), and the workers split the work among
+// themselves; Camera hands them tiles through an atomic counter.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threadCount)
+    {
+        for (int t = 0; t < threadCount; t++)
+        {
+            workers.emplace_back([this, t]()
+                                 { WorkerLoop(t); });
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        for (auto &worker: workers)
+        {
+            worker.join();
+        }
+    }
+
+    int Size() const
+    { return int(workers.size()); }
+
+    // Starts job on every worker and returns right away. Call Wait() before starting the next job.
+    void Start(std::function<void(int)> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            currentJob = std::move(job);
+            running = int(workers.size());
+            generation++;
+        }
+        jobReady.notify_all();
+    }
+
+    // Blocks until every worker has finished the current job.
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        jobDone.wait(lock, [this]()
+        { return running == 0; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    std::function<void(int)> currentJob;
+    uint64_t generation = 0;    // Incremented for every job, so workers can tell a new one from the last
+    int running = 0;            // Workers still busy with the current job
+    bool stopping = false;
+
+    void WorkerLoop(int threadNum)
+    {
+        uint64_t seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobReady.wait(lock, [&]()
+                { return stopping || generation != seen; });
+                if (stopping)
+                {
+                    return;
+                }
+                seen = generation;
+            }
+
+            // currentJob isn't replaced before every worker has reported back through Wait().
+            currentJob(threadNum);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--running == 0)
+            {
+                jobDone.notify_all();
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef TONE_MAP_H
+#define TONE_MAP_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define RT_TONE_MAP_X86 1
+#include <immintrin.h>
+#endif
+
+// Display transform from the renderer's linear float pixels to 8-bit output, kept apart from
+// rendering so a saved PFM or EXR image can be shown at another exposure or with another curve
+// without rendering it again. Every channel value goes through the same steps: exposure, tone
+// curve, clamp to [0, 1], gamma, then quantization with optional dithering.
+
+enum class ToneCurve
+{
+    Clamp,      // None: values above 1 clip to white
+    Reinhard,   // x / (1 + x), compresses all of [0, inf) into [0, 1)
+    Aces        // Narkowicz's fit of the ACES filmic curve, with a toe and a soft shoulder
+};
+
+struct ToneMapSettings
+{
+    double exposure = 0;                    // In stops: every stop doubles the brightness
+    ToneCurve curve = ToneCurve::Clamp;
+    double gamma = 2;                       // Display gamma; 2 is the renderer's classic output
+    bool dither = false;                    // Add triangular noise of one step before quantizing, against banding
+    uint32_t ditherSeed = 0;
+};
+
+inline const char *ToneCurveName(ToneCurve curve)
+{
+    switch (curve)
+    {
+        case ToneCurve::Clamp: return "clamp";
+        case ToneCurve::Reinhard: return "reinhard";
+        default: return "aces";
+    }
+}
+
+inline ToneCurve ParseToneCurve(const std::string &name)
+{
+    if (name == "clamp") return ToneCurve::Clamp;
+    if (name == "reinhard") return ToneCurve::Reinhard;
+    if (name == "aces") return ToneCurve::Aces;
+    throw std::runtime_error("Unknown tone curve " + name + ".");
+}
+
+// Integer hash (lowbias32 by Chris Wellons) of the value index, for dither noise that is the same
+// on every run and in both the scalar and the SIMD path.
+constexpr uint32_t DitherHash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// Inputs are clamped to [0, ToneMapMaxInput] before the curves, and NaN becomes 0. Reinhard would
+// map values below -1 above 1, and the curves would turn infinity into NaN; every curve is white
+// long before the cap.
+constexpr float ToneMapMaxInput = 1e6f;
+
+// Scalar reference of the whole transform for value index i, which only seeds the dither.
+inline uint8_t ToneMapValue(float value, const ToneMapSettings &settings, float scale, size_t i)
+{
+    constexpr float A = 2.51f, B = 0.03f, C = 2.43f, D = 0.59f, E = 0.14f;
+
+    float x = value * scale;
+    x = x > 0 ? std::min(x, ToneMapMaxInput) : 0.0f;
+    if (settings.curve == ToneCurve::Reinhard)
+    {
+        x = x / (1 + x);
+    }
+    else if (settings.curve == ToneCurve::Aces)
+    {
+        x = x * (A * x + B) / (x * (C * x + D) + E);
+    }
+
+    x = std::min(x, 1.0f);
+    if (settings.gamma == 2)
+    {
+        x = std::sqrt(x);
+    }
+    else if (settings.gamma != 1)
+    {
+        x = std::pow(x, float(1 / settings.gamma));
+    }
+
+    float q = x * 256;
+    if (settings.dither)
+    {
+        uint32_t h = DitherHash(uint32_t(i) ^ settings.ditherSeed);
+        q += float(h & 0xffff) * 0x1p-16f - float(h >> 16) * 0x1p-16f;
+    }
+    return uint8_t(std::clamp(q, 0.0f, 255.0f));
+}
+
+#ifdef RT_TONE_MAP_X86
+// Eight values per iteration; the gamma is 1 or 2 here, others need pow and take the scalar path.
+__attribute__((target("avx2")))
+inline void ToneMapAvx2(const float *values, uint8_t *out, size_t count, const ToneMapSettings &settings)
+{
+    const float scale = float(std::exp2(settings.exposure));
+    const __m256 vScale = _mm256_set1_ps(scale);
+    const __m256 maxInput = _mm256_set1_ps(ToneMapMaxInput);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 steps = _mm256_set1_ps(256.0f);
+    const __m256 maxStep = _mm256_set1_ps(255.0f);
+    const __m256 a = _mm256_set1_ps(2.51f), b = _mm256_set1_ps(0.03f), c = _mm256_set1_ps(2.43f);
+    const __m256 d = _mm256_set1_ps(0.59f), e = _mm256_set1_ps(0.14f);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i seed = _mm256_set1_epi32(int(settings.ditherSeed));
+    const __m256i low16 = _mm256_set1_epi32(0xffff);
+    const __m256 unit16 = _mm256_set1_ps(0x1p-16f);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        // max returns its second operand for NaN, so NaN becomes 0 as in the scalar path.
+        __m256 x = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(values + i), vScale), zero), maxInput);
+        if (settings.curve == ToneCurve::Reinhard)
+        {
+            x = _mm256_div_ps(x, _mm256_add_ps(one, x));
+        }
+        else if (settings.curve == ToneCurve::Aces)
+        {
+            __m256 numerator = _mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(a, x), b));
+            __m256 denominator = _mm256_add_ps(_mm256_mul_ps(x, _mm256_add_ps(_mm256_mul_ps(c, x), d)), e);
+            x = _mm256_div_ps(numerator, denominator);
+        }
+
+        x = _mm256_min_ps(x, one);
+        if (settings.gamma == 2)
+        {
+            x = _mm256_sqrt_ps(x);
+        }
+
+        __m256 q = _mm256_mul_ps(x, steps);
+        if (settings.dither)
+        {
+            __m256i h = _mm256_xor_si256(_mm256_add_epi32(_mm256_set1_epi32(int(uint32_t(i))), lanes), seed);
+            h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+            h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x7feb352d));
+            h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+            h = _mm256_mullo_epi32(h, _mm256_set1_epi32(int(0x846ca68b)));
+            h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+            __m256 u1 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(h, low16)), unit16);
+            __m256 u2 = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(h, 16)), unit16);
+            q = _mm256_add_ps(q, _mm256_sub_ps(u1, u2));
+        }
+        q = _mm256_min_ps(_mm256_max_ps(q, zero), maxStep);
+
+        alignas(32) int32_t steps32[8];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(steps32), _mm256_cvttps_epi32(q));
+        for (int k = 0; k < 8; k++)
+        {
+            out[i + k] = uint8_t(steps32[k]);
+        }
+    }
+
+    for (; i < count; i++)
+    {
+        out[i] = ToneMapValue(values[i], settings, scale, i);
+    }
+}
+#endif
+
+// Maps count linear values to display bytes. Values are independent of their neighbours, so RGB
+// pixels are just three values each.
+inline void ToneMap(const float *values, uint8_t *out, size_t count, const ToneMapSettings &settings)
+{
+#ifdef RT_TONE_MAP_X86
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    if (hasAvx2 && (settings.gamma == 1 || settings.gamma == 2))
+    {
+        ToneMapAvx2(values, out, count, settings);
+        return;
+    }
+#endif
+    const float scale = float(std::exp2(settings.exposure));
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = ToneMapValue(values[i], settings, scale, i);
+    }
+}
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "RTweekend.hpp"
+#include "Aabb.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+// Affine transform p -> A p + b, stored as the three rows of the 3x4 matrix [A | b].
+class Transform
+{
+public:
+    Real m[3][4] = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}};
+
+    static Transform Translate(const Vec3 &offset)
+    {
+        Transform t;
+        t.m[0][3] = offset.X();
+        t.m[1][3] = offset.Y();
+        t.m[2][3] = offset.Z();
+        return t;
+    }
+
+    static Transform Scale(Real sx, Real sy, Real sz)
+    {
+        Transform t;
+        t.m[0][0] = sx;
+        t.m[1][1] = sy;
+        t.m[2][2] = sz;
+        return t;
+    }
+
+    // Rotation by degrees counterclockwise about axis (0 = x, 1 = y, 2 = z), looking down the axis.
+    static Transform Rotate(int axis, double degrees)
+    {
+        auto radians = DegreesToRadians(degrees);
+        auto c = Real(std::cos(radians));
+        auto s = Real(std::sin(radians));
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+
+        Transform t;
+        t.m[u][u] = c;
+        t.m[u][v] = -s;
+        t.m[v][u] = s;
+        t.m[v][v] = c;
+        return t;
+    }
+
+    // The transform that applies other first, then this one.
+    Transform operator*(const Transform &other) const
+    {
+        Transform t;
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                t.m[i][j] = m[i][0] * other.m[0][j] + m[i][1] * other.m[1][j] + m[i][2] * other.m[2][j]
+                            + (j == 3 ? m[i][3] : 0);
+            }
+        }
+        return t;
+    }
+
+    bool operator==(const Transform &other) const
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                if (m[i][j] != other.m[i][j])
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool IsIdentity() const
+    { return *this == Transform(); }
+
+    // Computed in double whatever Real is, so single precision scenes get the most accurate inverse
+    // their precision can hold. Throws for transforms that flatten space.
+    Transform Inverse() const
+    {
+        double a[3][3];
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                a[i][j] = m[i][j];
+            }
+        }
+
+        double cofactor[3][3];
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                int i1 = (i + 1) % 3, i2 = (i + 2) % 3, j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+                cofactor[i][j] = a[i1][j1] * a[i2][j2] - a[i1][j2] * a[i2][j1];
+            }
+        }
+
+        double det = a[0][0] * cofactor[0][0] + a[0][1] * cofactor[0][1] + a[0][2] * cofactor[0][2];
+        if (det == 0 || !std::isfinite(det))
+        {
+            throw std::runtime_error("Transform has no inverse.");
+        }
+
+        Transform inverse;
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                inverse.m[i][j] = Real(cofactor[j][i] / det);
+            }
+        }
+        for (int i = 0; i < 3; i++)
+        {
+            inverse.m[i][3] = Real(-(cofactor[0][i] * m[0][3] + cofactor[1][i] * m[1][3] + cofactor[2][i] * m[2][3])
+                                   / det);
+        }
+        return inverse;
+    }
+
+    Vec3 Translation() const
+    { return Vec3(m[0][3], m[1][3], m[2][3]); }
+
+    Point3 ApplyPoint(const Point3 &p) const
+    {
+        return Point3(m[0][0] * p.X() + m[0][1] * p.Y() + m[0][2] * p.Z() + m[0][3],
+                      m[1][0] * p.X() + m[1][1] * p.Y() + m[1][2] * p.Z() + m[1][3],
+                      m[2][0] * p.X() + m[2][1] * p.Y() + m[2][2] * p.Z() + m[2][3]);
+    }
+
+    Vec3 ApplyVector(const Vec3 &v) const
+    {
+        return Vec3(m[0][0] * v.X() + m[0][1] * v.Y() + m[0][2] * v.Z(),
+                    m[1][0] * v.X() + m[1][1] * v.Y() + m[1][2] * v.Z(),
+                    m[2][0] * v.X() + m[2][1] * v.Y() + m[2][2] * v.Z());
+    }
+
+    // Multiplies v by the transpose of the linear part. Normals map to world space with the transpose
+    // of the inverse, so the world to object transform applies them this way.
+    Vec3 ApplyTransposed(const Vec3 &v) const
+    {
+        return Vec3(m[0][0] * v.X() + m[1][0] * v.Y() + m[2][0] * v.Z(),
+                    m[0][1] * v.X() + m[1][1] * v.Y() + m[2][1] * v.Z(),
+                    m[0][2] * v.X() + m[1][2] * v.Y() + m[2][2] * v.Z());
+    }
+
+    // Box around the transformed box: every output interval is the translation plus, per input axis,
+    // the smaller and larger of the two transformed slab bounds (Arvo, Graphics Gems 1990).
+    Aabb ApplyBox(const Aabb &box) const
+    {
+        // An empty box stays empty; its infinite bounds times a zero matrix entry would be NaN.
+        if (box.x.min > box.x.max || box.y.min > box.y.max || box.z.min > box.z.max)
+        {
+            return Aabb::empty;
+        }
+
+        Interval axes[3];
+        for (int i = 0; i < 3; i++)
+        {
+            Real low = m[i][3], high = m[i][3];
+            for (int j = 0; j < 3; j++)
+            {
+                const Interval &slab = box.AxisInterval(j);
+                auto a = m[i][j] * slab.min;
+                auto b = m[i][j] * slab.max;
+                low += std::min(a, b);
+                high += std::max(a, b);
+            }
+            axes[i] = Interval(low, high);
+        }
+        return Aabb(axes[0], axes[1], axes[2]);
+    }
+
+    // Largest factor by which the transform can grow a coordinate: the largest absolute row sum of
+    // the linear part. Scales position error bounds from object to world space.
+    Real MaxScale() const
+    {
+        Real scale = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            scale = std::max(scale, std::abs(m[i][0]) + std::abs(m[i][1]) + std::abs(m[i][2]));
+        }
+        return scale;
+    }
+};
+
+#endif
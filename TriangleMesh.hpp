@@ -0,0 +1,252 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "RTweekend.hpp"
+#include "HitTable.hpp"
+#include "FlatBvh.hpp"
+#include "Arena.hpp"
+#include "RenderStats.hpp"
+
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Triangles sharing one vertex buffer and one index buffer, three indices per triangle, with a single
+// material for the whole mesh. A triangle costs its 12 bytes of indices plus its share of vertices
+// and hierarchy nodes; there is no object per triangle. After Build(), an internal FlatBvh groups the
+// triangles into small leaves. Triangles wind counterclockwise seen from outside, the convention of
+// OBJ and PLY files, so the normals of closed meshes point out and Dielectric can tell inside from out.
+class TriangleMesh : public HitTable
+{
+public:
+    static constexpr int DefaultLeafSize = 4;
+
+    TriangleMesh() = default;
+
+    TriangleMesh(std::vector<Point3> vertices, std::vector<uint32_t> indices, MaterialId mat)
+            : vertices(std::move(vertices)), indices(std::move(indices)), mat(mat)
+    {
+        UpdateBounds();
+    }
+
+    MaterialId MeshMaterial() const
+    { return mat; }
+
+    size_t VertexCount() const
+    { return vertices.size(); }
+
+    size_t TriangleCount() const
+    { return indices.size() / 3; }
+
+    const std::vector<Point3> &Vertices() const
+    { return vertices; }
+
+    const std::vector<uint32_t> &Indices() const
+    { return indices; }
+
+    // Bytes held by the vertices, indices and hierarchy, for reporting the cost per triangle.
+    size_t MemoryBytes() const
+    {
+        return vertices.capacity() * sizeof(Point3) + indices.capacity() * sizeof(uint32_t) + bvh.MemoryBytes();
+    }
+
+    // Builds the internal hierarchy and reorders the triangles so that every leaf is contiguous. The
+    // builder's temporary arrays come from scratch.
+    void Build(Arena &scratch, int maxLeafSize = DefaultLeafSize)
+    {
+        auto order = bvh.Build(TriangleCount(), [this](uint32_t i)
+        { return TriangleBounds(i); }, maxLeafSize, scratch);
+
+        std::vector<uint32_t> permuted(indices.size());
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            std::copy_n(&indices[3 * size_t(order[i])], 3, &permuted[3 * i]);
+        }
+        indices.swap(permuted);
+    }
+
+    void Build(int maxLeafSize = DefaultLeafSize)
+    {
+        Arena scratch;
+        Build(scratch, maxLeafSize);
+    }
+
+    bool Hit(const Ray &r, Interval rayT, HitRecord &rec) const override
+    {
+        WatertightRay ray(r);
+        int closest = -1;
+        Real closestT = rayT.max;
+        Real b0 = 0, b1 = 0, b2 = 0;
+
+        auto hitLeaf = [&](uint32_t first, uint32_t count, Interval &t)
+        {
+            RT_STAT(threadStats.triangleTests += count);
+            bool hit = false;
+            for (uint32_t k = first; k < first + count; k++)
+            {
+                if (IntersectTriangle(ray, k, t, b0, b1, b2))
+                {
+                    closest = int(k);
+                    closestT = t.max;
+                    hit = true;
+                }
+            }
+            return hit;
+        };
+
+        if (bvh.Empty())
+        {
+            hitLeaf(0, uint32_t(TriangleCount()), rayT);
+        }
+        else
+        {
+            bvh.Traverse(r, rayT, hitLeaf);
+        }
+
+        if (closest < 0)
+        {
+            return false;
+        }
+        RT_STAT(threadStats.triangleHits++);
+
+        const Point3 &p0 = vertices[indices[3 * closest]];
+        const Point3 &p1 = vertices[indices[3 * closest + 1]];
+        const Point3 &p2 = vertices[indices[3 * closest + 2]];
+
+        // The barycentric interpolation lands on the triangle's plane, unlike r.at(t), which carries
+        // the error of t along the whole Ray.
+        rec.t = closestT;
+        rec.p = b0 * p0 + b1 * p1 + b2 * p2;
+        rec.pError = HitPositionError(b0 * MaxAbsComponent(p0) + b1 * MaxAbsComponent(p1) + b2 * MaxAbsComponent(p2));
+        rec.SetFaceNormal(r, UnitVector(Cross(p1 - p0, p2 - p0)));
+        rec.mat = mat;
+
+        return true;
+    }
+
+    Aabb BoundingBox() const override
+    { return bbox; }
+
+private:
+    std::vector<Point3> vertices;
+    std::vector<uint32_t> indices;  // Three per triangle
+    MaterialId mat = 0;
+    FlatBvh bvh;
+    Aabb bbox;
+
+    // The Ray in the space of the watertight test: the axis along which the direction is largest
+    // becomes z, and the shear (sx, sy) maps the direction onto it.
+    struct WatertightRay
+    {
+        Point3 origin;
+        int kx, ky, kz;
+        Real sx, sy, sz;
+
+        explicit WatertightRay(const Ray &r) : origin(r.origin())
+        {
+            const Vec3 &d = r.direction();
+            kz = std::abs(d.X()) > std::abs(d.Y()) ? (std::abs(d.X()) > std::abs(d.Z()) ? 0 : 2)
+                                                  : (std::abs(d.Y()) > std::abs(d.Z()) ? 1 : 2);
+            kx = kz == 2 ? 0 : kz + 1;
+            ky = kx == 2 ? 0 : kx + 1;
+
+            // Keeps the winding, so the sign of the edge functions doesn't depend on the direction.
+            if (d[kz] < 0)
+            {
+                std::swap(kx, ky);
+            }
+
+            sx = d[kx] / d[kz];
+            sy = d[ky] / d[kz];
+            sz = 1 / d[kz];
+        }
+    };
+
+    void UpdateBounds()
+    {
+        bbox = Aabb::empty;
+        for (uint32_t i = 0; i < TriangleCount(); i++)
+        {
+            bbox = Aabb(bbox, TriangleBounds(i));
+        }
+    }
+
+    // Box around triangle i. Axis aligned triangles would get a box of zero thickness, which the slab
+    // test never enters, so thin axes are padded.
+    Aabb TriangleBounds(uint32_t i) const
+    {
+        constexpr Real MinThickness = Real(1e-4);
+        const Point3 &p0 = vertices[indices[3 * size_t(i)]];
+        const Point3 &p1 = vertices[indices[3 * size_t(i) + 1]];
+        const Point3 &p2 = vertices[indices[3 * size_t(i) + 2]];
+        Aabb box(Aabb(p0, p1), Aabb(p2, p2));
+        for (auto *axis: {&box.x, &box.y, &box.z})
+        {
+            if (axis->Size() < MinThickness)
+            {
+                *axis = axis->Expand(MinThickness);
+            }
+        }
+        return box;
+    }
+
+    // Watertight ray/triangle test (Woop, Benthin and Wald, "Watertight Ray/Triangle Intersection",
+    // JCGT 2013). The edge functions are evaluated after translating and shearing the vertices into
+    // the Ray's space, so triangles sharing an edge compute it from the same values and a Ray
+    // crossing the edge hits at least one of them. On a hit inside rayT, shrinks rayT.max to the hit
+    // distance and sets the barycentric coordinates b0, b1 and b2.
+    bool IntersectTriangle(const WatertightRay &ray, uint32_t k, Interval &rayT, Real &b0, Real &b1, Real &b2) const
+    {
+        const Vec3 a = vertices[indices[3 * size_t(k)]] - ray.origin;
+        const Vec3 b = vertices[indices[3 * size_t(k) + 1]] - ray.origin;
+        const Vec3 c = vertices[indices[3 * size_t(k) + 2]] - ray.origin;
+
+        const Real ax = a[ray.kx] - ray.sx * a[ray.kz];
+        const Real ay = a[ray.ky] - ray.sy * a[ray.kz];
+        const Real bx = b[ray.kx] - ray.sx * b[ray.kz];
+        const Real by = b[ray.ky] - ray.sy * b[ray.kz];
+        const Real cx = c[ray.kx] - ray.sx * c[ray.kz];
+        const Real cy = c[ray.ky] - ray.sy * c[ray.kz];
+
+        Real u = cx * by - cy * bx;
+        Real v = ax * cy - ay * cx;
+        Real w = bx * ay - by * ax;
+
+        // A zero edge function in single precision may be rounding; decide the edge in double.
+        if constexpr (!std::is_same_v<Real, double>)
+        {
+            if (u == 0 || v == 0 || w == 0)
+            {
+                u = Real(double(cx) * double(by) - double(cy) * double(bx));
+                v = Real(double(ax) * double(cy) - double(ay) * double(cx));
+                w = Real(double(bx) * double(ay) - double(by) * double(ax));
+            }
+        }
+
+        if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
+        {
+            return false;
+        }
+
+        const Real det = u + v + w;
+        if (det == 0)
+        {
+            return false;
+        }
+
+        const Real t = (u * ray.sz * a[ray.kz] + v * ray.sz * b[ray.kz] + w * ray.sz * c[ray.kz]) / det;
+        if (!rayT.Surrounds(t))
+        {
+            return false;
+        }
+
+        rayT.max = t;
+        b0 = u / det;
+        b1 = v / det;
+        b2 = w / det;
+        return true;
+    }
+};
+
+#endif
@@ -1,36 +1,47 @@
 #ifndef VEC3_H
 #define VEC3_H
 
-class Vec3
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+// Three component vector over the scalar type T. The renderer uses Vec3, with the precision picked
+// by Real; other instantiations are for code that needs a specific precision.
+template<typename T>
+class Vec3T
 {
 public:
-    double e[3];
+    T e[3];
 
-    Vec3() : e{0, 0, 0}
+    Vec3T() : e{0, 0, 0}
     {}
 
-    Vec3(double e0, double e1, double e2) : e{e0, e1, e2}
+    Vec3T(T e0, T e1, T e2) : e{e0, e1, e2}
     {}
 
-    double X() const
+    template<typename U>
+    explicit Vec3T(const Vec3T<U> &v) : e{T(v.e[0]), T(v.e[1]), T(v.e[2])}
+    {}
+
+    T X() const
     { return e[0]; }
 
-    double Y() const
+    T Y() const
     { return e[1]; }
 
-    double Z() const
+    T Z() const
     { return e[2]; }
 
-    Vec3 operator-() const
-    { return Vec3(-e[0], -e[1], -e[2]); }
+    Vec3T operator-() const
+    { return Vec3T(-e[0], -e[1], -e[2]); }
 
-    double operator[](int i) const
+    T operator[](int i) const
     { return e[i]; }
 
-    double &operator[](int i)
+    T &operator[](int i)
     { return e[i]; }
 
-    Vec3 &operator+=(const Vec3 &v)
+    Vec3T &operator+=(const Vec3T &v)
     {
         e[0] += v.e[0];
         e[1] += v.e[1];
@@ -38,7 +49,7 @@ public:
         return *this;
     }
 
-    Vec3 &operator*=(double t)
+    Vec3T &operator*=(T t)
     {
         e[0] *= t;
         e[1] *= t;
@@ -46,17 +57,17 @@ public:
         return *this;
     }
 
-    Vec3 &operator/=(double t)
+    Vec3T &operator/=(T t)
     {
         return *this *= 1 / t;
     }
 
-    double Length() const
+    T Length() const
     {
         return sqrt(LengthSquared());
     }
 
-    double LengthSquared() const
+    T LengthSquared() const
     {
         return e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
     }
@@ -64,107 +75,177 @@ public:
     bool NearZero() const
     {
         // Return true if the vector is close to zero in all dimensions.
-        auto s = 1e-8;
+        auto s = T(1e-8);
         return (fabs(e[0]) < s) && (fabs(e[1]) < s) && (fabs(e[2]) < s);
     }
 
-    static Vec3 random()
+    static Vec3T random()
     {
-        return Vec3(RandomDouble(), RandomDouble(), RandomDouble());
+        return Vec3T(RandomDouble(), RandomDouble(), RandomDouble());
     }
 
-    static Vec3 random(double min, double max)
+    static Vec3T random(double min, double max)
     {
-        return Vec3(RandomDouble(min, max), RandomDouble(min, max), RandomDouble(min, max));
+        return Vec3T(RandomDouble(min, max), RandomDouble(min, max), RandomDouble(min, max));
     }
 };
 
+using Vec3 = Vec3T<Real>;
+
 // Point3 is just an alias for Vec3, but useful for geometric clarity in the code.
 using Point3 = Vec3;
 
 
 // Vector Utility Functions
+// Scalars are taken as std::type_identity_t<T>, so a double literal still works with a float Vec3T.
 
-inline std::ostream &operator<<(std::ostream &out, const Vec3 &v)
+template<typename T>
+inline std::ostream &operator<<(std::ostream &out, const Vec3T<T> &v)
 {
     return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
 }
 
-inline Vec3 operator+(const Vec3 &u, const Vec3 &v)
+template<typename T>
+inline Vec3T<T> operator+(const Vec3T<T> &u, const Vec3T<T> &v)
 {
-    return Vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
+    return Vec3T<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]);
 }
 
-inline Vec3 operator-(const Vec3 &u, const Vec3 &v)
+template<typename T>
+inline Vec3T<T> operator-(const Vec3T<T> &u, const Vec3T<T> &v)
 {
-    return Vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+    return Vec3T<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
 
-inline Vec3 operator*(const Vec3 &u, const Vec3 &v)
+template<typename T>
+inline Vec3T<T> operator*(const Vec3T<T> &u, const Vec3T<T> &v)
 {
-    return Vec3(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
+    return Vec3T<T>(u.e[0] * v.e[0], u.e[1] * v.e[1], u.e[2] * v.e[2]);
 }
 
-inline Vec3 operator*(double t, const Vec3 &v)
+template<typename T>
+inline Vec3T<T> operator*(std::type_identity_t<T> t, const Vec3T<T> &v)
 {
-    return Vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
+    return Vec3T<T>(t * v.e[0], t * v.e[1], t * v.e[2]);
 }
 
-inline Vec3 operator*(const Vec3 &v, double t)
+template<typename T>
+inline Vec3T<T> operator*(const Vec3T<T> &v, std::type_identity_t<T> t)
 {
     return t * v;
 }
 
-inline Vec3 operator/(const Vec3 &v, double t)
+template<typename T>
+inline Vec3T<T> operator/(const Vec3T<T> &v, std::type_identity_t<T> t)
 {
     return (1 / t) * v;
 }
 
-inline double Dot(const Vec3 &u, const Vec3 &v)
+template<typename T>
+inline T Dot(const Vec3T<T> &u, const Vec3T<T> &v)
 {
     return u.e[0] * v.e[0]
            + u.e[1] * v.e[1]
            + u.e[2] * v.e[2];
 }
 
-inline Vec3 Cross(const Vec3 &u, const Vec3 &v)
+template<typename T>
+inline Vec3T<T> Cross(const Vec3T<T> &u, const Vec3T<T> &v)
 {
-    return Vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
-                u.e[2] * v.e[0] - u.e[0] * v.e[2],
-                u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+    return Vec3T<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                    u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                    u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
 
-inline Vec3 UnitVector(const Vec3 &v)
+template<typename T>
+inline Vec3T<T> UnitVector(const Vec3T<T> &v)
 {
     return v / v.Length();
 }
 
-inline Vec3 RandomInUnitDisk() {
-    while (true) {
-        auto p = Vec3(RandomDouble(-1, 1), RandomDouble(-1, 1), 0);
-        if (p.LengthSquared() < 1)
-            return p;
-    }
+// Largest absolute component, the scale that floating point errors of v are relative to.
+template<typename T>
+inline T MaxAbsComponent(const Vec3T<T> &v)
+{
+    return std::max(std::max(std::abs(v.e[0]), std::abs(v.e[1])), std::abs(v.e[2]));
 }
 
-inline Vec3 RandomInUnitSphere()
+template<typename T>
+inline T MaxComponent(const Vec3T<T> &v)
 {
-    auto p = Vec3::random(-1, 1);
-    if (p.LengthSquared() < 1)
-    {
-        return p;
-    }
+    return std::max(std::max(v.e[0], v.e[1]), v.e[2]);
+}
+
+// Direct samplers. They map uniform numbers u1, u2 (and u3) in [0,1) straight to the target
+// distribution, without rejection loops or data dependent branches, so every call costs the same and
+// the caller decides where the numbers come from.
+
+// Uniformly distributed direction on the unit sphere.
+inline Vec3 SampleUniformSphere(Real u1, Real u2)
+{
+    auto z = 1 - 2 * u1;
+    auto r = std::sqrt(std::max(Real(0), 1 - z * z));
+    auto phi = Real(2 * PI) * u2;
+    return Vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// Uniformly distributed point in the unit disk (z = 0), with Shirley and Chiu's concentric mapping,
+// which keeps nearby u close together on the disk. The two wedges are picked with selects only.
+inline Vec3 SampleConcentricDisk(Real u1, Real u2)
+{
+    auto a = 2 * u1 - 1;
+    auto b = 2 * u2 - 1;
+
+    bool horizontal = std::abs(a) > std::abs(b);
+    auto r = horizontal ? a : b;
+    auto numerator = horizontal ? b : a;
+    auto ratio = numerator / (r != 0 ? r : Real(1));
+    auto phi = horizontal ? Real(PI / 4) * ratio : Real(PI / 2) - Real(PI / 4) * ratio;
+
+    return Vec3(r * std::cos(phi), r * std::sin(phi), 0);
+}
+
+// Cosine weighted direction in the hemisphere around the unit vector normal: a concentric disk
+// sample lifted onto the hemisphere (Malley's method), in a basis built without branches
+// (Duff et al., "Building an Orthonormal Basis, Revisited").
+inline Vec3 SampleCosineHemisphere(const Vec3 &normal, Real u1, Real u2)
+{
+    auto d = SampleConcentricDisk(u1, u2);
+    auto z = std::sqrt(std::max(Real(0), 1 - d.X() * d.X() - d.Y() * d.Y()));
+
+    auto sign = std::copysign(Real(1), normal.Z());
+    auto a = -1 / (sign + normal.Z());
+    auto b = normal.X() * normal.Y() * a;
+    Vec3 tangent(1 + sign * normal.X() * normal.X() * a, sign * b, -sign * normal.X());
+    Vec3 bitangent(b, sign + normal.Y() * normal.Y() * a, -normal.Y());
+
+    return d.X() * tangent + d.Y() * bitangent + z * normal;
+}
+
+inline Vec3 RandomInUnitDisk()
+{
+    auto u1 = Real(RandomDouble());
+    return SampleConcentricDisk(u1, Real(RandomDouble()));
 }
 
 inline Vec3 RandomUnitVector()
 {
-    return UnitVector(RandomInUnitSphere());
+    auto u1 = Real(RandomDouble());
+    return SampleUniformSphere(u1, Real(RandomDouble()));
+}
+
+inline Vec3 RandomInUnitSphere()
+{
+    // A uniform direction scaled by the cube root of a uniform number, so the density over the volume
+    // is constant.
+    auto direction = RandomUnitVector();
+    return std::cbrt(Real(RandomDouble())) * direction;
 }
 
 inline Vec3 RandomOnHemisphere(const Vec3 &normal)
 {
     Vec3 onUnitSphere = RandomUnitVector();
-    if (Dot(onUnitSphere, normal) > 0.0)
+    if (Dot(onUnitSphere, normal) > 0)
     { // In the same hemisphere as the normal
         return onUnitSphere;
     }
@@ -172,16 +253,18 @@ inline Vec3 RandomOnHemisphere(const Vec3 &normal)
     return -onUnitSphere;
 }
 
-inline Vec3 Reflect(const Vec3 &v, const Vec3 &n)
+template<typename T>
+inline Vec3T<T> Reflect(const Vec3T<T> &v, const Vec3T<T> &n)
 {
     return v - 2 * Dot(v, n) * n;
 }
 
-inline Vec3 Refract(const Vec3 &uv, const Vec3 &n, double etaiOverEtat)
+template<typename T>
+inline Vec3T<T> Refract(const Vec3T<T> &uv, const Vec3T<T> &n, std::type_identity_t<T> etaiOverEtat)
 {
-    auto cosTheta = fmin(Dot(-uv, n), 1.0);
-    Vec3 rOutPerp = etaiOverEtat * (uv + cosTheta * n);
-    Vec3 rOutParallel = -sqrt(fabs(1.0 - rOutPerp.LengthSquared())) * n;
+    auto cosTheta = std::min(Dot(-uv, n), T(1));
+    Vec3T<T> rOutPerp = etaiOverEtat * (uv + cosTheta * n);
+    Vec3T<T> rOutParallel = -std::sqrt(std::abs(1 - rOutPerp.LengthSquared())) * n;
     return rOutPerp + rOutParallel;
 }
 
@@ -0,0 +1,105 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "RTweekend.hpp"
+#include "HitTable.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Stages of the wavefront integrator, in the order every batch of paths runs through them.
+enum class WavefrontStage
+{
+    Generate,   // Camera rays for a batch of pixel samples
+    Intersect,  // Closest hit for every live path
+    Sort,       // Group the live paths by material type
+    Scatter,    // Material scatter for every path that hit something
+    Compact,    // Drop terminated paths
+    Reorder,    // Sort the survivors by direction and origin for coherent intersection (Camera::sortRays)
+    Count
+};
+
+// Rays processed and time spent per stage, summed over all threads.
+struct WavefrontStats
+{
+    uint64_t rays[int(WavefrontStage::Count)] = {};
+    double seconds[int(WavefrontStage::Count)] = {};
+
+    void Add(WavefrontStage stage, size_t rayCount, double elapsed)
+    {
+        rays[int(stage)] += rayCount;
+        seconds[int(stage)] += elapsed;
+    }
+
+    void Merge(const WavefrontStats &other)
+    {
+        for (int s = 0; s < int(WavefrontStage::Count); s++)
+        {
+            rays[s] += other.rays[s];
+            seconds[s] += other.seconds[s];
+        }
+    }
+
+    // Seconds are thread time, so rays/sec is the throughput of a single thread in that stage.
+    void Print(std::ostream &out) const
+    {
+        static const char *names[] = {"Generate", "Intersect", "Sort", "Scatter", "Compact", "Reorder"};
+
+        out << "Wavefront stages:\n";
+        for (int s = 0; s < int(WavefrontStage::Count); s++)
+        {
+            double raysPerSecond = seconds[s] > 0 ? rays[s] / seconds[s] : 0;
+            out << "  " << std::left << std::setw(10) << names[s] << std::right
+                << std::setw(14) << rays[s] << " rays " << std::fixed << std::setprecision(3)
+                << std::setw(10) << seconds[s] << " s " << std::setw(10) << raysPerSecond / 1e6
+                << " Mrays/s\n" << std::defaultfloat;
+        }
+    }
+};
+
+// One camera path in flight.
+struct PathState
+{
+    Ray ray;
+    Color throughput;       // Product of the attenuations along the path so far
+    uint32_t sample;        // Sample index within the pixel, which with the pixel and depth picks the sampler dimensions
+    uint32_t pixel;         // Index of the pixel inside the tile
+    bool alive;
+    bool guidesPending;     // Denoiser guides not recorded yet, the path has only met specular surfaces (Camera::renderAovs)
+};
+
+// Per-thread storage for the wavefront integrator, reused across tiles so a batch never allocates.
+struct WavefrontBuffers
+{
+    std::vector<PathState> paths;
+    std::vector<PathState> survivors;
+    std::vector<HitRecord> hits;
+    std::vector<uint32_t> order;        // Live path indices grouped by material type
+    std::vector<uint64_t> keys;         // Coherence sort keys, each with its path index
+    std::vector<Color> radiance;        // Accumulated color per tile pixel
+    std::vector<Color> albedo;          // First-hit albedo and normal per tile pixel (Camera::renderAovs)
+    std::vector<Vec3> normal;
+};
+
+class StageTimer
+{
+public:
+    StageTimer() : start(std::chrono::steady_clock::now())
+    {}
+
+    // Returns the seconds since the last call (or construction) and restarts the timer.
+    double Lap()
+    {
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        start = now;
+        return elapsed;
+    }
+
+private:
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif
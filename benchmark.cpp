@@ -0,0 +1,324 @@
+// Standard C++ library headers
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Internal project-specific headers
+#include "RTweekend.hpp"
+#include "Camera.hpp"
+#include "Scenes.hpp"
+#include "PerfCounters.hpp"
+
+// Renders a fixed set of scenes with fixed seeds, resolution and sample count, and writes the
+// timings as JSON to stdout so results can be compared across changes. A readable summary goes to
+// stderr.
+
+struct BenchmarkOptions
+{
+    int imageWidth = 400;
+    int samplesPerPixel = 16;
+    int maxThreads = std::max(1, int(std::thread::hardware_concurrency()));
+    bool scaling = true;
+    bool russianRoulette = true;
+    TileOrder tileOrder = TileOrder::Morton;
+    bool wavefront = false;
+    bool sortRays = false;
+    bool compareOrders = false;
+    std::string scene;      // Empty runs every scene
+    bool help = false;
+};
+
+// One timed render.
+struct RenderRun
+{
+    int threads = 0;
+    double seconds = 0;
+    RenderStats stats;
+    PerfCounts counters;
+
+    double MraysPerSecond() const
+    { return seconds > 0 ? stats.TotalRays() / seconds / 1e6 : 0; }
+};
+
+void PrintUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --width N          Image width in pixels (default 400)\n"
+              << "  --spp N            Samples per pixel (default 16)\n"
+              << "  --scene NAME       Only run this scene\n"
+              << "  --max-threads N    Largest thread count to run (default: all hardware threads)\n"
+              << "  --no-scaling       Skip the thread scaling runs\n"
+              << "  --no-roulette      Disable Russian roulette, for comparing path lengths\n"
+              << "  --tile-order NAME  scanline, morton (default) or hilbert\n"
+              << "  --wavefront        Render with the wavefront integrator\n"
+              << "  --sort-rays        Sort bounced wavefront rays by direction and origin\n"
+              << "  --compare-orders   Also time every tile order, with cache counters, at the largest thread count\n"
+              << "  --help             Show this message\n"
+              << "Scenes:";
+    for (const auto &scene: builtinScenes)
+    {
+        std::cerr << " " << scene.name;
+    }
+    std::cerr << "\n";
+}
+
+BenchmarkOptions ParseOptions(int argc, char *argv[])
+{
+    BenchmarkOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string
+        {
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("Missing value for " + arg + ".");
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--width") options.imageWidth = std::stoi(value());
+        else if (arg == "--spp") options.samplesPerPixel = std::stoi(value());
+        else if (arg == "--scene") options.scene = value();
+        else if (arg == "--max-threads") options.maxThreads = std::max(1, std::stoi(value()));
+        else if (arg == "--no-scaling") options.scaling = false;
+        else if (arg == "--no-roulette") options.russianRoulette = false;
+        else if (arg == "--tile-order") options.tileOrder = ParseTileOrder(value());
+        else if (arg == "--wavefront") options.wavefront = true;
+        else if (arg == "--sort-rays") options.sortRays = true;
+        else if (arg == "--compare-orders") options.compareOrders = true;
+        else if (arg == "--help") options.help = true;
+        else throw std::runtime_error("Unknown option " + arg + ".");
+    }
+
+    return options;
+}
+
+// Thread counts for the scaling curve: powers of two up to maxThreads, and maxThreads itself.
+std::vector<int> ScalingThreadCounts(int maxThreads)
+{
+    std::vector<int> counts;
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+    {
+        counts.push_back(threads);
+    }
+    counts.push_back(maxThreads);
+    return counts;
+}
+
+RenderRun TimeRender(Camera &cam, const Scene &scene, int threads)
+{
+    cam.threadCount = threads;
+
+    PerfCounters counters;
+    counters.Start();
+    auto start = std::chrono::steady_clock::now();
+    cam.Render(scene, scene.materials);
+    auto end = std::chrono::steady_clock::now();
+
+    RenderRun run;
+    run.threads = threads;
+    run.seconds = std::chrono::duration<double>(end - start).count();
+    run.stats = cam.renderStats;
+    run.counters = counters.Stop();
+    return run;
+}
+
+// A count as JSON, null when the machine doesn't provide it.
+std::string CountJson(const std::optional<uint64_t> &count)
+{
+    return count ? std::to_string(*count) : "null";
+}
+
+void WriteCounters(std::ostream &out, const PerfCounts &counts)
+{
+    out << "\"instructions\": " << CountJson(counts.instructions)
+        << ", \"cache_references\": " << CountJson(counts.cacheReferences)
+        << ", \"cache_misses\": " << CountJson(counts.cacheMisses)
+        << ", \"l1d_misses\": " << CountJson(counts.l1dMisses);
+}
+
+void WriteRun(std::ostream &out, const RenderRun &run)
+{
+    out << "{\"threads\": " << run.threads << ", \"render_s\": " << run.seconds
+        << ", \"total_rays\": " << run.stats.TotalRays() << ", \"mrays_per_s\": " << run.MraysPerSecond() << "}";
+}
+
+void PrintCounters(const PerfCounts &counts)
+{
+    if (!counts.Available())
+    {
+        std::cerr << ", no hardware counters";
+    }
+    if (counts.cacheMisses)
+    {
+        std::cerr << ", " << *counts.cacheMisses << " cache misses";
+    }
+    if (counts.l1dMisses)
+    {
+        std::cerr << ", " << *counts.l1dMisses << " L1d misses";
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    BenchmarkOptions options;
+    try
+    {
+        options = ParseOptions(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << e.what() << "\n";
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    if (options.help)
+    {
+        PrintUsage(argv[0]);
+        return 0;
+    }
+
+    auto &out = std::cout;
+    out << std::fixed << std::setprecision(6);
+    out << "{\n"
+        << "  \"image_width\": " << options.imageWidth << ",\n"
+        << "  \"samples_per_pixel\": " << options.samplesPerPixel << ",\n"
+        << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+        << "  \"max_threads\": " << options.maxThreads << ",\n"
+        << "  \"russian_roulette\": " << (options.russianRoulette ? "true" : "false") << ",\n"
+        << "  \"tile_order\": \"" << TileOrderName(options.tileOrder) << "\",\n"
+        << "  \"integrator\": \"" << (options.wavefront ? "wavefront" : "iterative") << "\",\n"
+        << "  \"sort_rays\": " << (options.sortRays ? "true" : "false") << ",\n"
+        << "  \"scenes\": [";
+
+    bool firstScene = true;
+    for (const auto &benchmark: builtinScenes)
+    {
+        if (!options.scene.empty() && options.scene != benchmark.name)
+        {
+            continue;
+        }
+
+        Scene scene = benchmark.build();
+
+        auto buildStart = std::chrono::steady_clock::now();
+        scene.Build();
+        double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+        Camera &cam = *scene.camera;
+        cam.imageWidth = options.imageWidth;
+        cam.samplesPerPixel = options.samplesPerPixel;
+        cam.seed = 0;
+        cam.verbose = false;
+        cam.russianRoulette = options.russianRoulette;
+        cam.tileOrder = options.tileOrder;
+        cam.integrator = options.wavefront ? Integrator::Wavefront : Integrator::Iterative;
+        cam.sortRays = options.sortRays;
+
+        std::cerr << benchmark.name << ": " << scene.world.Size() << " spheres, " << scene.TriangleCount()
+                  << " triangles, BVH built in " << buildMs << " ms\n";
+
+        RenderRun primary = TimeRender(cam, scene, options.maxThreads);
+        std::cerr << "  " << primary.threads << " threads: " << primary.seconds << " s, " << primary.MraysPerSecond()
+                  << " Mrays/s, " << primary.stats.AveragePathLength() << " rays per path";
+        PrintCounters(primary.counters);
+        std::cerr << "\n";
+
+        // The same render in every tile order, for the effect of the order on the caches.
+        std::vector<std::pair<TileOrder, RenderRun>> orders;
+        if (options.compareOrders)
+        {
+            for (auto order: {TileOrder::Scanline, TileOrder::Morton, TileOrder::Hilbert})
+            {
+                cam.tileOrder = order;
+                orders.emplace_back(order, order == options.tileOrder ? primary
+                                                                      : TimeRender(cam, scene, options.maxThreads));
+                std::cerr << "  " << TileOrderName(order) << " order: " << orders.back().second.seconds << " s";
+                PrintCounters(orders.back().second.counters);
+                std::cerr << "\n";
+            }
+            cam.tileOrder = options.tileOrder;
+        }
+
+        std::vector<RenderRun> scaling;
+        if (options.scaling)
+        {
+            for (int threads: ScalingThreadCounts(options.maxThreads))
+            {
+                scaling.push_back(threads == primary.threads ? primary : TimeRender(cam, scene, threads));
+                const auto &run = scaling.back();
+                std::cerr << "  scaling " << run.threads << " threads: " << run.seconds << " s, speedup "
+                          << scaling.front().seconds / run.seconds << "\n";
+            }
+        }
+
+        out << (firstScene ? "\n" : ",\n");
+        firstScene = false;
+
+        out << "    {\n"
+            << "      \"name\": \"" << benchmark.name << "\",\n"
+            << "      \"spheres\": " << scene.world.Size() << ",\n"
+            << "      \"triangles\": " << scene.TriangleCount() << ",\n"
+            << "      \"instances\": " << scene.instances.InstanceCount() << ",\n"
+            << "      \"geometry_mb\": " << double(scene.instances.MemoryBytes()) / (1 << 20) << ",\n"
+            << "      \"materials\": " << scene.materials.Size() << ",\n"
+            << "      \"build_ms\": " << buildMs << ",\n"
+            << "      \"threads\": " << primary.threads << ",\n"
+            << "      \"render_s\": " << primary.seconds << ",\n"
+            << "      \"total_rays\": " << primary.stats.TotalRays() << ",\n"
+            << "      \"mrays_per_s\": " << primary.MraysPerSecond() << ",\n"
+            << "      \"avg_path_length\": " << primary.stats.AveragePathLength() << ",\n"
+            << "      \"roulette_terminations\": " << primary.stats.rouletteTerminations << ",\n"
+            << "      ";
+        WriteCounters(out, primary.counters);
+        out << ",\n"
+            << "      \"rays_per_depth\": [";
+
+        // Trailing depths nobody reached are left out.
+        int depthCount = MaxStatsDepth;
+        while (depthCount > 0 && primary.stats.raysPerDepth[depthCount - 1] == 0)
+        {
+            depthCount--;
+        }
+        for (int d = 0; d < depthCount; d++)
+        {
+            out << (d > 0 ? ", " : "") << primary.stats.raysPerDepth[d];
+        }
+        out << "],\n";
+
+        if (options.compareOrders)
+        {
+            out << "      \"tile_orders\": [";
+            for (size_t o = 0; o < orders.size(); o++)
+            {
+                const auto &[order, run] = orders[o];
+                out << (o > 0 ? ",\n" : "\n") << "        {\"tile_order\": \"" << TileOrderName(order)
+                    << "\", \"render_s\": " << run.seconds << ", ";
+                WriteCounters(out, run.counters);
+                out << "}";
+            }
+            out << "\n      ],\n";
+        }
+
+        out << "      \"scaling\": [";
+
+        for (size_t r = 0; r < scaling.size(); r++)
+        {
+            out << (r > 0 ? ",\n" : "\n") << "        ";
+            WriteRun(out, scaling[r]);
+        }
+        out << (scaling.empty() ? "]\n" : "\n      ]\n") << "    }";
+    }
+
+    out << "\n  ]\n}\n";
+    return 0;
+}
@@ -1,8 +1,11 @@
 // Standard C++ library headers
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <filesystem>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
 
 // Conditional system headers based on the OS
 #if defined(__APPLE__) || defined(__linux__)
@@ -14,166 +17,596 @@
 #endif
 
 // External library headers
+#ifdef RT_HAVE_MAGICK
 #include <Magick++.h>
+#endif
 
 // Internal project-specific headers
 #include "RTweekend.hpp"
 #include "Camera.hpp"
-#include "HitTableList.hpp"
 #include "Material.hpp"
-#include "Sphere.hpp"
-
-HitTableList SetupWorld();
-
-void SetupMaterials(HitTableList &world);
+#include "SphereSet.hpp"
+#include "Scenes.hpp"
+#include "SceneFile.hpp"
+#include "ImageWriter.hpp"
+#include "ImageReader.hpp"
+#include "ToneMap.hpp"
+#include "CameraPath.hpp"
+#include "FrameWriter.hpp"
+#include "Distributed.hpp"
 
-void ConvertImageAndDisplay(std::string ppmFileName)
+// Writes the image in the format given by the file extension. PNG, PPM, PFM and EXR are written
+// directly; any other format goes through Magick++ when it is available. PFM and EXR keep the linear
+// values, every other format is tone mapped with toneMap.
+void SaveImage(const Image &image, const std::string &fileName, const ToneMapSettings &toneMap = {})
 {
-    try
+    std::filesystem::path path(fileName);
+    if (path.has_parent_path())
+    {
+        std::filesystem::create_directories(path.parent_path());
+    }
+
+    auto extension = path.extension().string();
+    if (extension == ".png")
+    {
+        WritePNG(image, fileName, toneMap);
+    }
+    else if (extension == ".ppm")
+    {
+        WritePPM(image, fileName, toneMap);
+    }
+    else if (extension == ".pfm")
     {
-        Magick::Image testImage;
-        testImage.read((ppmFileName + ".ppm").c_str());
-        testImage.write((ppmFileName + ".png").c_str());
+        WritePFM(image, fileName);
+    }
+    else if (extension == ".exr")
+    {
+        WriteEXR(image, fileName);
+    }
+    else
+    {
+#ifdef RT_HAVE_MAGICK
+        auto bytes = image.ToBytes(toneMap);
+        Magick::Image magickImage;
+        magickImage.read(image.Width(), image.Height(), "RGB", Magick::CharPixel, bytes.data());
+        magickImage.write(fileName);
+#else
+        throw std::runtime_error("Unsupported image format '" + extension + "'. Build with Magick++ for more formats.");
+#endif
+    }
+}
 
-        // Open the output file with the default application
-        std::string command;
+void DisplayImage(const std::string &fileName)
+{
+    // Open the output file with the default application
+    std::string command;
 #if defined(__APPLE__)
-        command = "open " + ppmFileName + ".png";
-        system(command.c_str());
+    command = "open " + fileName;
+    system(command.c_str());
 #elif defined(__linux__)
-        command = "xdg-open " + ppmFileName + ".png";
-        system(command.c_str());
+    command = "xdg-open " + fileName;
+    system(command.c_str());
 #elif defined(_WIN32)
-        command = ppmFileName + ".png";
-        ShellExecute(NULL, "open", command.c_str(), NULL, NULL, SW_SHOWNORMAL);
+    ShellExecute(NULL, "open", fileName.c_str(), NULL, NULL, SW_SHOWNORMAL);
 #endif
-    }
-    catch (const Magick::Exception &error_)
+}
+
+// Command line settings. Zero leaves the scene's Camera value in place.
+struct Options
+{
+    std::string output = "../output/texture.png";
+    std::string scene = "random_spheres";
+    std::string saveScene;
+    int imageWidth = 0;
+    int samplesPerPixel = 0;
+    int threads = 0;
+    SamplerType sampler = SamplerType::Sobol;
+    TileOrder tileOrder = TileOrder::Morton;
+    bool russianRoulette = true;
+    int rouletteMinDepth = -1;
+    bool adaptive = false;
+    bool progressive = false;
+    double timeBudget = 0;
+    int snapshotInterval = 0;
+    std::string resumeFile;
+    std::string accumulationFile;
+    std::string traceFile;
+    std::string hdrInput;
+    ToneMapSettings toneMap;
+    bool denoise = false;
+    bool saveAovs = false;
+    std::string cameraPath;
+    int frames = 30;
+    int localWorkers = 0;
+    std::vector<std::string> workerCommands;
+    int regionSize = 64;
+    double regionTimeout = 600;
+    bool worker = false;
+    bool display = true;
+    bool help = false;
+};
+
+void PrintUsage(const char *program)
+{
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --output FILE            Output image (.png, .ppm, .pfm, .exr; others need Magick++)\n"
+              << "  --scene NAME|FILE        Built-in scene or scene file (.rtscene binary, otherwise text)\n"
+              << "  --save-scene FILE        Write the scene to a file instead of rendering it\n"
+              << "  --width N                Image width in pixels\n"
+              << "  --spp N                  Samples per pixel (maximum or target for adaptive/progressive)\n"
+              << "  --threads N              Render threads, 0 for all hardware threads\n"
+              << "  --sampler NAME           independent, stratified or sobol (default)\n"
+              << "  --tile-order NAME        Order of tiles and pixels: scanline, morton (default) or hilbert\n"
+              << "  --no-roulette            Trace every path to a miss or the maximum depth\n"
+              << "  --roulette-depth N       Rays every path traces before Russian roulette (default 3)\n"
+              << "  --adaptive               Stop sampling converged pixels early\n"
+              << "  --progressive            Render one sample pass at a time\n"
+              << "  --time-budget SECONDS    Stop a progressive render before this much time has passed\n"
+              << "  --snapshot-every N       Write a snapshot image every N progressive passes\n"
+              << "  --resume FILE            Continue a progressive render from a saved accumulation buffer\n"
+              << "  --save-accumulation FILE Save the accumulation buffer after a progressive render\n"
+              << "  --camera-path FILE       Render an animation along a keyframed camera path\n"
+              << "  --frames N               Frames of the animation (default 30), written as OUTPUT_0000 etc.\n"
+              << "  --workers N              Render on N local worker processes\n"
+              << "  --worker-command CMD     Also render on a worker started by CMD, e.g. 'ssh host inOneWeekend'\n"
+              << "  --region-size N          Width and height of the regions handed to workers (default 64)\n"
+              << "  --region-timeout S       Seconds per region before a worker is dropped (default 600)\n"
+              << "  --exposure STOPS         Brighten (or darken, if negative) the 8-bit output\n"
+              << "  --tone-curve NAME        clamp (default), reinhard or aces\n"
+              << "  --gamma G                Display gamma of the 8-bit output (default 2)\n"
+              << "  --dither                 Dither the 8-bit output against banding\n"
+              << "  --from-hdr FILE          Tone map a saved .pfm or .exr image to --output instead of rendering\n"
+              << "  --denoise                Filter the image guided by first-hit albedo and normal buffers\n"
+              << "  --save-aovs              Also write those buffers as OUTPUT_albedo.pfm and OUTPUT_normal.pfm\n"
+              << "  --trace FILE             Write a Chrome trace of the tile timeline (needs RT_STATS)\n"
+              << "  --no-display             Don't open the image when done\n"
+              << "  --help                   Show this message\n";
+}
+
+const char *SamplerTypeName(SamplerType type)
+{
+    switch (type)
     {
-        std::cout << "Caught exception: " << error_.what() << std::endl;
+        case SamplerType::Independent: return "independent";
+        case SamplerType::Stratified: return "stratified";
+        default: return "sobol";
     }
 }
 
-void RenameFile(std::string ppmFileName)
+SamplerType ParseSamplerType(const std::string &name)
 {
-    try
+    if (name == "independent") return SamplerType::Independent;
+    if (name == "stratified") return SamplerType::Stratified;
+    if (name == "sobol") return SamplerType::Sobol;
+    throw std::runtime_error("Unknown sampler " + name + ".");
+}
+
+Options ParseOptions(int argc, char *argv[])
+{
+    Options options;
+
+    for (int i = 1; i < argc; i++)
     {
-        // check if texture already exists
-        if (std::filesystem::exists(ppmFileName + ".ppm"))
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string
         {
-            std::filesystem::remove(ppmFileName + ".ppm");
-        }
+            if (i + 1 >= argc)
+            {
+                throw std::runtime_error("Missing value for " + arg + ".");
+            }
+            return argv[++i];
+        };
 
-        // rename
-        if (std::rename((ppmFileName + ".txt").c_str(), (ppmFileName + ".ppm").c_str()) != 0)
-        {
-            throw std::runtime_error("Failed to rename file.");
-        }
-        std::cout << "File renamed successfully from " << ppmFileName + ".txt" << " to " << ppmFileName + ".ppm" <<
-                  ".\n";
+        if (arg == "--output") options.output = value();
+        else if (arg == "--scene") options.scene = value();
+        else if (arg == "--save-scene") options.saveScene = value();
+        else if (arg == "--width") options.imageWidth = std::stoi(value());
+        else if (arg == "--spp") options.samplesPerPixel = std::stoi(value());
+        else if (arg == "--threads") options.threads = std::stoi(value());
+        else if (arg == "--sampler") options.sampler = ParseSamplerType(value());
+        else if (arg == "--tile-order") options.tileOrder = ParseTileOrder(value());
+        else if (arg == "--no-roulette") options.russianRoulette = false;
+        else if (arg == "--roulette-depth") options.rouletteMinDepth = std::stoi(value());
+        else if (arg == "--adaptive") options.adaptive = true;
+        else if (arg == "--progressive") options.progressive = true;
+        else if (arg == "--time-budget") options.timeBudget = std::stod(value());
+        else if (arg == "--snapshot-every") options.snapshotInterval = std::stoi(value());
+        else if (arg == "--resume") options.resumeFile = value();
+        else if (arg == "--save-accumulation") options.accumulationFile = value();
+        else if (arg == "--trace") options.traceFile = value();
+        else if (arg == "--exposure") options.toneMap.exposure = std::stod(value());
+        else if (arg == "--tone-curve") options.toneMap.curve = ParseToneCurve(value());
+        else if (arg == "--gamma") options.toneMap.gamma = std::stod(value());
+        else if (arg == "--dither") options.toneMap.dither = true;
+        else if (arg == "--from-hdr") options.hdrInput = value();
+        else if (arg == "--denoise") options.denoise = true;
+        else if (arg == "--save-aovs") options.saveAovs = true;
+        else if (arg == "--camera-path") options.cameraPath = value();
+        else if (arg == "--frames") options.frames = std::stoi(value());
+        else if (arg == "--workers") options.localWorkers = std::stoi(value());
+        else if (arg == "--worker-command") options.workerCommands.push_back(value());
+        else if (arg == "--region-size") options.regionSize = std::stoi(value());
+        else if (arg == "--region-timeout") options.regionTimeout = std::stod(value());
+        else if (arg == "--worker") options.worker = true;
+        else if (arg == "--no-display") options.display = false;
+        else if (arg == "--help") options.help = true;
+        else throw std::runtime_error("Unknown option " + arg + ".");
     }
-    catch (const std::runtime_error &e)
+
+    // Resuming or keeping the accumulation buffer only makes sense for progressive renders.
+    options.progressive |= !options.resumeFile.empty() || !options.accumulationFile.empty() || options.timeBudget > 0;
+
+    // Workers return only the color of their regions, rendered once at the full sample count.
+    if (options.localWorkers > 0 || !options.workerCommands.empty())
     {
-        std::cerr << "Error: " << e.what() << std::endl;
-        perror("System error");
+        if (options.denoise || options.saveAovs)
+        {
+            throw std::runtime_error("--denoise and --save-aovs don't work with distributed rendering.");
+        }
+        if (options.progressive)
+        {
+            throw std::runtime_error("--progressive, --time-budget, --resume and --save-accumulation don't work "
+                                     "with distributed rendering.");
+        }
+        if (!options.cameraPath.empty())
+        {
+            throw std::runtime_error("--camera-path doesn't work with distributed rendering.");
+        }
+        if (!options.traceFile.empty())
+        {
+            throw std::runtime_error("--trace doesn't work with distributed rendering.");
+        }
     }
+    return options;
 }
 
-std::unique_ptr<Camera> SetupCamera()
+// Inserts suffix between the stem and the extension of fileName.
+std::string SuffixedFileName(const std::string &fileName, const std::string &suffix)
 {
-    auto cam = std::make_unique<Camera>();
-
-    cam->aspectRatio = 16.0 / 9.0;
-    cam->imageWidth = 1200;
-    cam->samplesPerPixel = 100;
-    cam->maxDepth = 20;
-
-    cam->vFov = 20;
-    cam->lookFrom = Point3(13, 2, 3);
-    cam->lookAt = Point3(0, 0, 0);
-    cam->vUp = Vec3(0, 1, 0);
+    std::filesystem::path path(fileName);
+    return (path.parent_path() / (path.stem().string() + suffix + path.extension().string())).string();
+}
 
-    cam->defocusAngle = 0.6;
-    cam->focusDist = 10.0;
+// File next to the output that the first-hit buffer called name is saved to: "frame.png" becomes
+// "frame_albedo.pfm" for the albedo.
+std::string AovFileName(const std::string &fileName, const std::string &name)
+{
+    return std::filesystem::path(SuffixedFileName(fileName, "_" + name)).replace_extension(".pfm").string();
+}
 
-    return cam;
+// Output file of frame index of an animation: "frame.png" becomes "frame_0007.png".
+std::string FrameFileName(const std::string &fileName, int index)
+{
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), "_%04d", index);
+    return SuffixedFileName(fileName, suffix);
 }
 
-int main()
+// Renders the frames of an animation along the camera path. The world and its BVH are built once by
+// the caller and the camera's thread pool serves every frame, while a FrameWriter encodes and saves
+// each finished frame as the next one renders.
+void RenderAnimation(Scene &scene, const Options &options)
 {
-    HitTableList world = SetupWorld();
+    auto path = LoadCameraPath(options.cameraPath);
+    auto &cam = *scene.camera;
+    cam.verbose = false;
 
-    SetupMaterials(world);
+    FrameWriter writer([&options](const Image &image, const std::string &fileName)
+                       { SaveImage(image, fileName, options.toneMap); });
+    auto animationStart = std::chrono::steady_clock::now();
 
-    auto cam = SetupCamera();
+    for (int frame = 0; frame < options.frames; frame++)
+    {
+        path.Apply(cam, path.FrameTime(frame, options.frames));
 
-    std::ofstream ppmFile;
-    std::string const ppmFileName = "../output/texture";
-    ppmFile.open(ppmFileName + ".txt");
+        auto frameStart = std::chrono::steady_clock::now();
+        cam.Render(scene, scene.materials);
+        auto frameEnd = std::chrono::steady_clock::now();
 
-    cam->Render(world, ppmFile);
+        auto fileName = FrameFileName(options.output, frame);
+        writer.Submit(std::move(cam.frameBuffer), fileName);
+        std::cout << "Frame " << frame + 1 << "/" << options.frames << ": "
+                  << std::chrono::duration<double>(frameEnd - frameStart).count() << " s, " << fileName << "\n";
+    }
+    writer.Finish();
 
-    ppmFile.close();
-    RenameFile(ppmFileName);
-    ConvertImageAndDisplay(ppmFileName);
+    std::cout << "Animation time: "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - animationStart).count() << " s\n";
+}
 
-    return 0;
+std::string ShellQuote(const std::string &text)
+{
+    std::string quoted = "'";
+    for (char c: text)
+    {
+        quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    }
+    return quoted + "'";
+}
+
+// Arguments that make a worker render the same image as this process: the scene and every option
+// that changes pixels. Output, display and progressive options don't apply to workers.
+std::string WorkerArguments(const Options &options, int threads)
+{
+    std::string arguments = " --worker --scene " + ShellQuote(options.scene);
+    if (options.imageWidth > 0) arguments += " --width " + std::to_string(options.imageWidth);
+    if (options.samplesPerPixel > 0) arguments += " --spp " + std::to_string(options.samplesPerPixel);
+    if (threads > 0) arguments += " --threads " + std::to_string(threads);
+    arguments += std::string(" --sampler ") + SamplerTypeName(options.sampler);
+    if (options.adaptive) arguments += " --adaptive";
+    if (!options.russianRoulette) arguments += " --no-roulette";
+    if (options.rouletteMinDepth >= 0) arguments += " --roulette-depth " + std::to_string(options.rouletteMinDepth);
+    return arguments;
 }
 
-void SetupMaterials(HitTableList &world)
+// Commands starting the workers of a distributed render: options.localWorkers copies of this program,
+// sharing the hardware threads, and every --worker-command.
+std::vector<std::string> WorkerCommands(const Options &options, const char *argv0)
 {
-    auto material1 = std::__1::make_shared<Dielectric>(1.5);
-    world.Add(std::__1::make_shared<Sphere>(Point3(0, 1, 0), 1.0, material1));
+    std::string self = argv0;
+    std::error_code error;
+    auto executable = std::filesystem::canonical("/proc/self/exe", error);
+    if (!error)
+    {
+        self = executable.string();
+    }
 
-    auto material2 = std::__1::make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
-    world.Add(std::__1::make_shared<Sphere>(Point3(-4, 1, 0), 1.0, material2));
+    std::vector<std::string> commands;
+    int localThreads = options.threads;
+    if (localThreads <= 0 && options.localWorkers > 0)
+    {
+        localThreads = std::max(1, int(std::thread::hardware_concurrency()) / options.localWorkers);
+    }
+    for (int w = 0; w < options.localWorkers; w++)
+    {
+        commands.push_back(ShellQuote(self) + WorkerArguments(options, localThreads));
+    }
+    for (const auto &command: options.workerCommands)
+    {
+        commands.push_back(command + WorkerArguments(options, options.threads));
+    }
+    return commands;
+}
 
-    auto material3 = std::__1::make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
-    world.Add(std::__1::make_shared<Sphere>(Point3(4, 1, 0), 1.0, material3));
+// Builds the built-in scene called name, or loads the scene file of that name.
+Scene OpenScene(const std::string &name)
+{
+    for (const auto &builtin: builtinScenes)
+    {
+        if (name == builtin.name)
+        {
+            return builtin.build();
+        }
+    }
+
+    auto loadStart = std::chrono::steady_clock::now();
+    Scene scene = LoadScene(name);
+    auto loadEnd = std::chrono::steady_clock::now();
+    std::cout << "Scene load time: " << std::chrono::duration<double, std::milli>(loadEnd - loadStart).count()
+              << " ms\n";
+    return scene;
 }
 
-HitTableList SetupWorld()
+int main(int argc, char *argv[])
 {
-    // World
-    HitTableList world;
+    Options options;
+    try
+    {
+        options = ParseOptions(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    if (options.help)
+    {
+        PrintUsage(argv[0]);
+        return 0;
+    }
 
-    auto groundMaterial = std::__1::make_shared<Lambertian>(Color(0.5, 0.5, 0.5));
-    world.Add(std::__1::make_shared<Sphere>(Point3(0, -1000, 0), 1000, groundMaterial));
+    if (!options.hdrInput.empty())
+    {
+        try
+        {
+            auto toneMapStart = std::chrono::steady_clock::now();
+            SaveImage(ReadHdrImage(options.hdrInput), options.output, options.toneMap);
+            auto toneMapEnd = std::chrono::steady_clock::now();
+            std::cout << "Tone mapped " << options.hdrInput << " to " << options.output << " in "
+                      << std::chrono::duration<double, std::milli>(toneMapEnd - toneMapStart).count() << " ms\n";
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+
+        if (options.display)
+        {
+            DisplayImage(options.output);
+        }
+        return 0;
+    }
 
-    for (int a = -11; a < 11; a++)
+    int protocolFd = -1;
+    if (options.worker)
     {
-        for (int b = -11; b < 11; b++)
+        try
+        {
+            protocolFd = TakeStdoutForProtocol();
+        }
+        catch (const std::exception &e)
         {
-            auto chooseMat = RandomDouble();
-            Point3 center(a + 0.9 * RandomDouble(), 0.2, b + 0.9 * RandomDouble());
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    Scene scene;
+    try
+    {
+        scene = OpenScene(options.scene);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    auto &materials = scene.materials;
+
+    auto &cam = scene.camera;
+    if (options.imageWidth > 0) cam->imageWidth = options.imageWidth;
+    if (options.samplesPerPixel > 0) cam->samplesPerPixel = options.samplesPerPixel;
+
+    if (!options.saveScene.empty())
+    {
+        try
+        {
+            SaveScene(scene, options.saveScene);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Saved " << scene.world.Size() << " spheres and " << scene.TriangleCount() << " triangles to "
+                  << options.saveScene << "\n";
+        return 0;
+    }
+
+    auto buildStart = std::chrono::steady_clock::now();
+    scene.Build();
+    auto buildEnd = std::chrono::steady_clock::now();
+    std::cout << "BVH build time: "
+              << std::chrono::duration<double, std::milli>(buildEnd - buildStart).count() << " ms ("
+              << scene.world.Size() << " spheres, " << scene.TriangleCount() << " triangles)\n";
+    if (scene.instances.InstanceCount() > 0)
+    {
+        std::cout << "Instances: " << scene.instances.InstanceCount() << " of " << scene.instances.MeshCount()
+                  << " meshes with " << scene.instances.UniqueTriangleCount() << " unique triangles, "
+                  << double(scene.instances.MemoryBytes()) / (1 << 20) << " MB\n";
+    }
+
+    cam->threadCount = options.threads;
+    cam->sampler = options.sampler;
+    cam->tileOrder = options.tileOrder;
+    cam->russianRoulette = options.russianRoulette;
+    if (options.rouletteMinDepth >= 0) cam->rouletteMinDepth = options.rouletteMinDepth;
+    cam->adaptiveSampling = options.adaptive;
+    cam->timeBudget = options.timeBudget;
+    cam->snapshotInterval = options.snapshotInterval;
+    cam->denoise = options.denoise;
+    cam->renderAovs = options.saveAovs;
+
+    if (options.worker)
+    {
+        try
+        {
+            RunRenderWorker(*cam, scene, materials, scene.Fingerprint(), 0, protocolFd);  // Regions arrive on stdin
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
 
-            if ((center - Point3(4, 0.2, 0)).Length() > 0.9)
+    if (options.localWorkers > 0 || !options.workerCommands.empty())
+    {
+        try
+        {
+            auto renderStart = std::chrono::steady_clock::now();
+            cam->frameBuffer = RenderDistributed(*cam, scene.Fingerprint(), WorkerCommands(options, argv[0]),
+                                                 options.regionSize, options.regionTimeout, cam->renderStats);
+            auto renderEnd = std::chrono::steady_clock::now();
+            cam->renderStats.Print(std::cout);
+            std::cout << "Render time: " << std::chrono::duration<double>(renderEnd - renderStart).count() << " s\n";
+            SaveImage(cam->frameBuffer, options.output, options.toneMap);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+
+        if (options.display)
+        {
+            DisplayImage(options.output);
+        }
+        return 0;
+    }
+
+    if (!options.cameraPath.empty())
+    {
+        try
+        {
+            RenderAnimation(scene, options);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    try
+    {
+        auto renderStart = std::chrono::steady_clock::now();
+        if (options.progressive)
+        {
+            if (!options.resumeFile.empty())
+            {
+                cam->LoadAccumulation(options.resumeFile);
+                std::cout << "Resuming at " << cam->accumulatedSamples << " samples per pixel.\n";
+            }
+
+            auto snapshotFileName = SuffixedFileName(options.output, "_snapshot");
+            cam->RenderProgressive(scene, materials, [&](const Image &image, int)
+            {
+                SaveImage(image, snapshotFileName, options.toneMap);
+            });
+
+            if (!options.accumulationFile.empty())
             {
-                std::__1::shared_ptr<Material> sphereMaterial;
-
-                if (chooseMat < 0.8)
-                {
-                    // diffuse
-                    auto albedo = Color::random() * Color::random();
-                    sphereMaterial = std::__1::make_shared<Lambertian>(albedo);
-                    world.Add(std::__1::make_shared<Sphere>(center, 0.2, sphereMaterial));
-                }
-                else if (chooseMat < 0.95)
-                {
-                    // Metal
-                    auto albedo = Color::random(0.5, 1);
-                    auto fuzz = RandomDouble(0, 0.5);
-                    sphereMaterial = std::__1::make_shared<Metal>(albedo, fuzz);
-                    world.Add(std::__1::make_shared<Sphere>(center, 0.2, sphereMaterial));
-                }
-                else
-                {
-                    // glass
-                    sphereMaterial = std::__1::make_shared<Dielectric>(1.5);
-                    world.Add(std::__1::make_shared<Sphere>(center, 0.2, sphereMaterial));
-                }
+                cam->SaveAccumulation(options.accumulationFile);
             }
         }
+        else
+        {
+            cam->Render(scene, materials);
+        }
+        auto renderEnd = std::chrono::steady_clock::now();
+        std::cout << "Render time: " << std::chrono::duration<double>(renderEnd - renderStart).count() << " s\n";
+
+        SaveImage(cam->frameBuffer, options.output, options.toneMap);
+        if (options.saveAovs)
+        {
+            SaveImage(cam->albedoBuffer, AovFileName(options.output, "albedo"));
+            SaveImage(cam->normalBuffer, AovFileName(options.output, "normal"));
+        }
+        if (!options.traceFile.empty())
+        {
+            WriteChromeTrace(cam->tileTimings, options.traceFile);
+        }
+        if (cam->adaptiveSampling)
+        {
+            SaveImage(cam->SampleHeatmap(), SuffixedFileName(options.output, "_spp"));
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
     }
-    return world;
+
+    if (options.display)
+    {
+        DisplayImage(options.output);
+    }
+
+    return 0;
 }
@@ -0,0 +1,59 @@
+// Instances of meshes without triangles, such as an OBJ point cloud or a PLY with no faces, must not
+// turn the instance or scene bounds into NaN, which used to send the SAH build out of its bins.
+
+#include "Scenes.hpp"
+
+#include <cmath>
+#include <iostream>
+
+static bool IsFinite(const Aabb &box)
+{
+    for (int axis = 0; axis < 3; axis++)
+    {
+        const auto &slab = box.AxisInterval(axis);
+        if (!std::isfinite(slab.min) || !std::isfinite(slab.max))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    Scene scene;
+    MaterialId mat = scene.materials.Add(Lambertian(Color(0.5, 0.5, 0.5)));
+
+    auto triangle = scene.instances.AddMesh(TriangleMesh({Point3(0, 0, 0), Point3(1, 0, 0), Point3(0, 1, 0)},
+                                                         {0, 1, 2}, mat));
+    auto pointCloud = scene.instances.AddMesh(TriangleMesh({Point3(0, 0, 0), Point3(1, 1, 1)}, {}, mat));
+    auto empty = scene.instances.AddMesh(TriangleMesh({}, {}, mat));
+    for (int i = 0; i < 6; i++)
+    {
+        scene.instances.AddInstance(triangle, Transform::Translate(Vec3(2 * i, 0, 0)));
+        scene.instances.AddInstance(pointCloud, Transform());
+        scene.instances.AddInstance(empty, Transform::Translate(Vec3(0, 2 * i, 0)));
+    }
+    scene.Build();
+
+    int failures = 0;
+    if (!IsFinite(scene.BoundingBox()))
+    {
+        std::cerr << "The scene bounds are not finite.\n";
+        failures++;
+    }
+
+    HitRecord rec;
+    if (!scene.Hit(Ray(Point3(10.25, 0.25, 5), Vec3(0, 0, -1)), Interval(0.001, RT_INFINITY), rec)
+        || std::abs(rec.t - 5) > 1e-6)
+    {
+        std::cerr << "A Ray towards the last triangle missed it.\n";
+        failures++;
+    }
+    if (scene.Hit(Ray(Point3(0.5, 10.5, 5), Vec3(0, 0, -1)), Interval(0.001, RT_INFINITY), rec))
+    {
+        std::cerr << "A Ray hit where only empty meshes are placed.\n";
+        failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}